@@ -0,0 +1,93 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "peachos.h"
+
+// Drive numbers the kernel hands out (0:/ .. 9:/)
+#define IOSTAT_MAX_DISKS 10
+// TSC cycles between two samples, roughly a second on a 2 GHz machine
+#define IOSTAT_INTERVAL (1ULL << 31)
+
+// Note: a * scale / b with 32-bit division only, we link without libgcc so 64-bit division is not available
+static int iostat_ratio(uint64_t a, uint64_t b, int scale)
+{
+    while (a > 0xFFFF || b > 0xFFFF)
+    {
+        a >>= 1;
+        b >>= 1;
+    }
+
+    if (b == 0)
+    {
+        return 0;
+    }
+
+    return (int)((uint32_t) a * scale / (uint32_t) b);
+}
+
+static void iostat_print_histogram(int disk_id, struct disk_stats* stats)
+{
+    printf("\ndisk %i latency (TSC cycles):", disk_id);
+    for (int i = 0; i < PEACHOS_DISK_LATENCY_BUCKETS; i++)
+    {
+        if (stats->latency_histogram[i])
+        {
+            printf("\n  2^%i: %i", i, stats->latency_histogram[i]);
+        }
+    }
+}
+
+// Note: takes a sample of every disk, then every interval prints what each disk did since the last one, until a key is pressed
+int main(int argc, char** argv)
+{
+    struct disk_stats last[IOSTAT_MAX_DISKS];
+    int total_disks = 0;
+
+    while (total_disks < IOSTAT_MAX_DISKS && peachos_disk_stats(total_disks, &last[total_disks]) == 0)
+    {
+        total_disks++;
+    }
+
+    if (total_disks == 0)
+    {
+        print("\niostat: no disks");
+        return 0;
+    }
+
+    print("\ndisk   commands   KiB read   errors   busy %  (any key quits)");
+    bool running = true;
+    while (running)
+    {
+        // Here: we wait for an interval to pass, the kernel stamps every sample with the TSC
+        struct disk_stats now;
+        do
+        {
+            peachos_disk_stats(0, &now);
+            if (peachos_getkey())
+            {
+                running = false;
+            }
+        } while (running && now.timestamp - last[0].timestamp < IOSTAT_INTERVAL);
+
+        for (int i = 0; i < total_disks; i++)
+        {
+            if (peachos_disk_stats(i, &now) < 0)
+            {
+                continue;
+            }
+
+            printf("\n%i      %i         %i         %i        %i", i,
+                (int)(now.commands - last[i].commands),
+                (int)((now.bytes - last[i].bytes) >> 10),
+                (int)(now.errors - last[i].errors),
+                iostat_ratio(now.busy_time - last[i].busy_time, now.timestamp - last[i].timestamp, 100));
+            last[i] = now;
+        }
+    }
+
+    for (int i = 0; i < total_disks; i++)
+    {
+        iostat_print_histogram(i, &last[i]);
+    }
+
+    return 0;
+}
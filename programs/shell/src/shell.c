@@ -4,16 +4,16 @@
 #include "string.h"
 #include "peachos.h"
 
-char* current_directory = "0:/";
+// Note: the kernel keeps our current directory, this is its path as of the last prompt
+char current_directory[PEACHOS_MAX_PATH] = "0:/";
 
 int main(int argc, char** argv) {
     
-    size_t o = strlen(current_directory);
-    if (o) {}
     print("PeachOS v2.0.0\n");
     printf("Shell ID: %s\n", argv[0]);
     print("Press '~' to switch between shells\n");
     while(1) {
+        peachos_getcwd(current_directory, sizeof(current_directory));
         print(current_directory);
         print("> ");
         char buf[1024];
@@ -28,20 +28,72 @@ int main(int argc, char** argv) {
     return 0;
 }
 
+// Note: FAT dates pack the year since 1980 in bits 9-15, the month in 5-8 and the day in 0-4
+static void shell_print_date(uint16_t date) {
+    printf("%i-%i-%i", 1980 + (date >> 9), (date >> 5) & 0x0F, date & 0x1F);
+}
+
+// Note: lists (path), the kernel hands us a batch of entries per call
+static void shell_ls(const char* path) {
+    int fd = peachos_opendir(path);
+    if (fd <= 0) {
+        printf("\nls: cannot open %s", path);
+        return;
+    }
+
+    print("\n filename          size            date");
+    struct file_dirent entries[64];
+    int total = 0;
+    while ((total = peachos_readdir(fd, entries, sizeof(entries))) > 0) {
+        for (int i = 0; i < total; i++) {
+            struct file_dirent* entry = &entries[i];
+            printf("\n %s", entry->name);
+            for (int pad = strlen(entry->name); pad < 18; pad++) {
+                putchar(' ');
+            }
+
+            if (entry->flags & FILE_DIRENT_DIRECTORY) {
+                print("<DIR>           ");
+            } else {
+                printf("%i", entry->size);
+                // Here: we pad the size column to 16 characters
+                for (int pad = strlen(itoa(entry->size)); pad < 16; pad++) {
+                    putchar(' ');
+                }
+            }
+            shell_print_date(entry->last_mod_date);
+        }
+    }
+
+    fclose(fd);
+}
+
 void parsenexec(char* command) {
     struct command_argument* commands = peachos_parse_command(command, 1024);
 
     if(istrncmp("cd", commands->argument, 1025) == 0) {
-        print("\nChanging directory...");
+        // Note: "cd" alone or "cd /" takes us back to the root of the drive we are on
+        char root[] = "0:/";
+        root[0] = current_directory[0];
+        const char* path = root;
+        if (commands->next && strncmp(commands->next->argument, "/", 2) != 0) {
+            path = commands->next->argument;
+        }
+
+        if (peachos_chdir(path) < 0) {
+            printf("\ncd: cannot change to %s", path);
+        }
     }
 
     if(istrncmp("ls", commands->argument, 1025) == 0) {
-        print("\n filename          date            permissions     ");
+        shell_ls(commands->next ? commands->next->argument : ".");
     }
 
     if(istrncmp("pwd", commands->argument, 1025) == 0) {
         print("\n");
-        print(current_directory);
+        if (peachos_getcwd(current_directory, sizeof(current_directory)) == 0) {
+            print(current_directory);
+        }
     }
 
     if(istrncmp("-h", commands->argument, 1025) == 0) {
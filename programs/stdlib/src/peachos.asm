@@ -11,6 +11,22 @@ global peachos_process_load_start: function
 global peachos_process_get_arguments: function
 global peachos_system: function
 global peachos_exit: function
+global peachos_disk_stats: function
+global peachos_fopen: function
+global peachos_fread: function
+global peachos_fseek: function
+global peachos_fstat: function
+global peachos_fclose: function
+global peachos_mmap: function
+global peachos_munmap: function
+global peachos_opendir: function
+global peachos_readdir: function
+global peachos_fwrite: function
+global peachos_mkdir: function
+global peachos_chdir: function
+global peachos_getcwd: function
+global peachos_openat: function
+global peachos_fallocate: function
 
 
 ; void print(const char* message)
@@ -107,4 +123,199 @@ peachos_process_get_arguments:
     int 0x80
     add esp, 4
     pop ebp
+    ret
+
+; int peachos_disk_stats(int disk_id, struct disk_stats* stats)
+peachos_disk_stats:
+    push ebp
+    mov ebp, esp
+    mov eax, 10 ; Command 10 gets the I/O stats of a disk
+    push dword[ebp+12] ; Variable stats
+    push dword[ebp+8] ; Variable disk_id
+    int 0x80
+    add esp, 8
+    pop ebp
+    ret
+
+; int peachos_fopen(const char* filename, const char* mode)
+peachos_fopen:
+    push ebp
+    mov ebp, esp
+    mov eax, 11 ; Command 11 opens a file
+    push dword[ebp+12] ; Variable mode
+    push dword[ebp+8] ; Variable filename
+    int 0x80
+    add esp, 8
+    pop ebp
+    ret
+
+; int peachos_fread(int fd, void* ptr, unsigned int count)
+peachos_fread:
+    push ebp
+    mov ebp, esp
+    mov eax, 12 ; Command 12 reads from a file
+    push dword[ebp+16] ; Variable count
+    push dword[ebp+12] ; Variable ptr
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int peachos_fseek(int fd, int offset, int whence)
+peachos_fseek:
+    push ebp
+    mov ebp, esp
+    mov eax, 13 ; Command 13 moves the position in a file
+    push dword[ebp+16] ; Variable whence
+    push dword[ebp+12] ; Variable offset
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int peachos_fstat(int fd, struct file_stat* stat)
+peachos_fstat:
+    push ebp
+    mov ebp, esp
+    mov eax, 14 ; Command 14 gets information on a file
+    push dword[ebp+12] ; Variable stat
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 8
+    pop ebp
+    ret
+
+; int peachos_fclose(int fd)
+peachos_fclose:
+    push ebp
+    mov ebp, esp
+    mov eax, 15 ; Command 15 closes a file
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; void* peachos_mmap(int fd, unsigned int offset, unsigned int size, int flags)
+peachos_mmap:
+    push ebp
+    mov ebp, esp
+    mov eax, 16 ; Command 16 maps a file into memory
+    push dword[ebp+20] ; Variable flags
+    push dword[ebp+16] ; Variable size
+    push dword[ebp+12] ; Variable offset
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 16
+    pop ebp
+    ret
+
+; int peachos_munmap(void* start)
+peachos_munmap:
+    push ebp
+    mov ebp, esp
+    mov eax, 17 ; Command 17 unmaps a mapped file
+    push dword[ebp+8] ; Variable start
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int peachos_opendir(const char* path)
+peachos_opendir:
+    push ebp
+    mov ebp, esp
+    mov eax, 18 ; Command 18 opens a directory for listing
+    push dword[ebp+8] ; Variable path
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int peachos_readdir(int fd, struct file_dirent* entries, unsigned int size)
+peachos_readdir:
+    push ebp
+    mov ebp, esp
+    mov eax, 19 ; Command 19 reads the next entries of a directory
+    push dword[ebp+16] ; Variable size
+    push dword[ebp+12] ; Variable entries
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int peachos_fwrite(int fd, const void* ptr, unsigned int count)
+peachos_fwrite:
+    push ebp
+    mov ebp, esp
+    mov eax, 20 ; Command 20 writes to a file
+    push dword[ebp+16] ; Variable count
+    push dword[ebp+12] ; Variable ptr
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int peachos_mkdir(const char* path)
+peachos_mkdir:
+    push ebp
+    mov ebp, esp
+    mov eax, 21 ; Command 21 creates a directory
+    push dword[ebp+8] ; Variable path
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int peachos_chdir(const char* path)
+peachos_chdir:
+    push ebp
+    mov ebp, esp
+    mov eax, 22 ; Command 22 changes the current directory
+    push dword[ebp+8] ; Variable path
+    int 0x80
+    add esp, 4
+    pop ebp
+    ret
+
+; int peachos_getcwd(char* buf, unsigned int size)
+peachos_getcwd:
+    push ebp
+    mov ebp, esp
+    mov eax, 23 ; Command 23 gets the path of the current directory
+    push dword[ebp+12] ; Variable size
+    push dword[ebp+8] ; Variable buf
+    int 0x80
+    add esp, 8
+    pop ebp
+    ret
+
+; int peachos_openat(int dirfd, const char* filename, const char* mode)
+peachos_openat:
+    push ebp
+    mov ebp, esp
+    mov eax, 24 ; Command 24 opens a file relative to an open directory
+    push dword[ebp+16] ; Variable mode
+    push dword[ebp+12] ; Variable filename
+    push dword[ebp+8] ; Variable dirfd
+    int 0x80
+    add esp, 12
+    pop ebp
+    ret
+
+; int peachos_fallocate(int fd, unsigned int offset, unsigned int length)
+peachos_fallocate:
+    push ebp
+    mov ebp, esp
+    mov eax, 25 ; Command 25 reserves room for a file on disk
+    push dword[ebp+16] ; Variable length
+    push dword[ebp+12] ; Variable offset
+    push dword[ebp+8] ; Variable fd
+    int 0x80
+    add esp, 12
+    pop ebp
     ret
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define PEACHOS_H
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+// Must match the kernel's PEACHOS_DISK_LATENCY_BUCKETS
+#define PEACHOS_DISK_LATENCY_BUCKETS 32
 
 struct command_argument {
     char argument[512];
@@ -13,6 +17,49 @@ struct process_arguments {
     char** argv;
 };
 
+// I/O stats of a disk, same layout as the kernel's struct disk_stats
+struct disk_stats {
+    uint64_t commands;
+    uint64_t sectors;
+    uint64_t bytes;
+    uint64_t errors;
+    // TSC cycles the kernel spent waiting on the disk
+    uint64_t busy_time;
+    // Bucket n counts commands that took 2^n to 2^(n+1) - 1 TSC cycles
+    uint32_t latency_histogram[PEACHOS_DISK_LATENCY_BUCKETS];
+    // TSC when the kernel took this copy
+    uint64_t timestamp;
+};
+
+// Same layout as the kernel's struct file_stat
+struct file_stat {
+    unsigned int flags;
+    uint32_t filesize;
+};
+
+#define FILE_DIRENT_DIRECTORY 0b00000001
+#define FILE_DIRENT_READ_ONLY 0b00000010
+#define FILE_DIRENT_HIDDEN    0b00000100
+
+// Same layout as the kernel's struct file_dirent, dates and times are in the FAT on-disk format
+struct file_dirent {
+    char name[16];
+    uint32_t flags;
+    uint32_t size;
+    uint16_t creation_date;
+    uint16_t creation_time;
+    uint16_t last_mod_date;
+    uint16_t last_mod_time;
+};
+
+// Same values as the kernel's mmap flags: shared mappings are read-only, private ones copy a page on the first write
+#define PEACHOS_MAP_SHARED  0
+#define PEACHOS_MAP_PRIVATE 1
+
+// Same value as the kernel's PEACHOS_AT_CWD: peachos_openat looks relative paths up from the current directory
+#define PEACHOS_AT_CWD 0
+#define PEACHOS_MAX_PATH 108
+
 void print(const char* message);
 int peachos_getkey();
 void* peachos_malloc(size_t size);
@@ -26,6 +73,22 @@ void peachos_process_get_arguments(struct process_arguments* arguments);
 int peachos_system(struct command_argument* arguments);
 int peachos_system_run(const char* command);
 void peachos_exit();
+int peachos_disk_stats(int disk_id, struct disk_stats* stats);
+int peachos_fopen(const char* filename, const char* mode);
+int peachos_fread(int fd, void* ptr, unsigned int count);
+int peachos_fseek(int fd, int offset, int whence);
+int peachos_fstat(int fd, struct file_stat* stat);
+int peachos_fclose(int fd);
+void* peachos_mmap(int fd, unsigned int offset, unsigned int size, int flags);
+int peachos_munmap(void* start);
+int peachos_opendir(const char* path);
+int peachos_readdir(int fd, struct file_dirent* entries, unsigned int size);
+int peachos_fwrite(int fd, const void* ptr, unsigned int count);
+int peachos_mkdir(const char* path);
+int peachos_chdir(const char* path);
+int peachos_getcwd(char* buf, unsigned int size);
+int peachos_openat(int dirfd, const char* filename, const char* mode);
+int peachos_fallocate(int fd, unsigned int offset, unsigned int length);
 
 
 #endif
\ No newline at end of file
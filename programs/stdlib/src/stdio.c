@@ -46,4 +46,49 @@ int printf(const char* fmt, ... ) {
     va_end(ap);
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Note: returns a descriptor of the process, or a negative status
+int fopen(const char* filename, const char* mode) {
+    return peachos_fopen(filename, mode);
+}
+
+// Note: like the kernel's fread, returns how many whole elements were read. The kernel reads straight into (ptr)
+int fread(void* ptr, unsigned int size, unsigned int nmemb, int fd) {
+    if (size == 0 || nmemb == 0 || nmemb > 0x7FFFFFFF / size) {
+        return -1;
+    }
+
+    int res = peachos_fread(fd, ptr, size * nmemb);
+    if (res < 0) {
+        return res;
+    }
+
+    return res / size;
+}
+
+// Note: returns how many whole elements were written, files open with "w" or "a" only (e.g. on the tmpfs at 9:/)
+int fwrite(const void* ptr, unsigned int size, unsigned int nmemb, int fd) {
+    if (size == 0 || nmemb == 0 || nmemb > 0x7FFFFFFF / size) {
+        return -1;
+    }
+
+    int res = peachos_fwrite(fd, ptr, size * nmemb);
+    if (res < 0) {
+        return res;
+    }
+
+    return res / size;
+}
+
+int fseek(int fd, int offset, int whence) {
+    return peachos_fseek(fd, offset, whence);
+}
+
+int fstat(int fd, struct file_stat* stat) {
+    return peachos_fstat(fd, stat);
+}
+
+int fclose(int fd) {
+    return peachos_fclose(fd);
+}
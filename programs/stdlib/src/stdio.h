@@ -4,5 +4,19 @@
 int putchar (int c);
 int printf(const char* format, ... );
 
+// Same values as the kernel's FILE_SEEK_MODE
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+struct file_stat;
+
+int fopen(const char* filename, const char* mode);
+int fread(void* ptr, unsigned int size, unsigned int nmemb, int fd);
+int fwrite(const void* ptr, unsigned int size, unsigned int nmemb, int fd);
+int fseek(int fd, int offset, int whence);
+int fstat(int fd, struct file_stat* stat);
+int fclose(int fd);
+
 
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 ORG 0x7c00
 BITS 16
 
+; The kernel is read as KERNEL_LOAD_CHUNKS * 255 sectors, all of them sit in the FAT reserved area
+KERNEL_LOAD_CHUNKS equ 4
+
 CODE_SEG equ gdt_code - gdt_start
 DATA_SEG equ gdt_data - gdt_start
 
@@ -11,7 +14,7 @@ nop
 OEMIdentifier           db 'PEACHOS '
 BytesPerSector          dw 0x200
 SectorsPerCluster       db 0x80
-ReservedSectors         dw 200
+ReservedSectors         dw 1021 ; Boot sector + KERNEL_LOAD_CHUNKS * 255 kernel sectors
 FATCopies               db 0x02
 RootDirEntries          dw 0x40
 NumSectors              dw 0x00
@@ -84,9 +87,17 @@ gdt_descriptor:
  [BITS 32]
  load32:
     mov eax, 1
-    mov ecx, 100
     mov edi, 0x0100000 ; This is where our kernel code will start from
-    call ata_lba_read
+    mov esi, KERNEL_LOAD_CHUNKS
+.load_chunk:
+    ; One command can only move 255 sectors (the count register is a byte), so we read the kernel in chunks
+    push eax
+    mov ecx, 255
+    call ata_lba_read ; Note: edi keeps advancing, so each chunk lands right after the previous one
+    pop eax
+    add eax, 255
+    dec esi
+    jnz .load_chunk
     jmp CODE_SEG:0x0100000
 
 ata_lba_read:
@@ -15,11 +15,58 @@
 
 #define PEACHOS_SECTOR_SIZE 512
 
+// Most sectors a single ATA command may transfer: LBA28 encodes the count in one byte, LBA48 in two
+#define PEACHOS_DISK_LBA28_MAX_SECTORS 256
+#define PEACHOS_DISK_LBA48_MAX_SECTORS 65536
+// Highest sector + 1 reachable with a 28-bit LBA
+#define PEACHOS_DISK_LBA28_LIMIT 0x10000000
+
+// Pending requests per disk before the queue is drained on its own
+#define PEACHOS_DISK_QUEUE_MAX_DEPTH 32
+// Largest command (in sectors) the queue builds when merging requests
+#define PEACHOS_DISK_QUEUE_MAX_MERGE_SECTORS 256
+// Most commands any driver keeps in flight at once (NCQ allows 32 tags per port)
+#define PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT 32
+// Disks and partitions we keep track of, paths address them with a single digit (0:/ .. 9:/)
+#define PEACHOS_MAX_DISKS 10
+// Buckets of the per-disk latency histogram, bucket n counts commands that took 2^n to 2^(n+1) - 1 TSC cycles
+#define PEACHOS_DISK_LATENCY_BUCKETS 32
+// Copy the boot disk into memory at boot and serve 0:/ from there (1 = yes, 0 = no)
+#define PEACHOS_RAMDISK_ENABLED 1
+// Most of the boot disk we copy, sectors past it are read from the disk itself
+#define PEACHOS_RAMDISK_MAX_BYTES 33554432
+
 #define PEACHOS_MAX_FILESYSTEMS 12
+// Descriptors per table: the kernel has one table and every process its own
 #define PEACHOS_MAX_FILE_DESCRIPTORS 512
 
 #define PEACHOS_MAX_PATH 108
 
+// The directory descriptor openat takes for "the current directory", descriptors start at 1 so it is never a real one
+#define PEACHOS_AT_CWD 0
+
+// Directory entries we cache by (parent, name), hits skip reading and scanning the parent directory
+#define PEACHOS_DCACHE_MAX_ENTRIES 128
+#define PEACHOS_DCACHE_BUCKETS 64
+// Longer names are looked up every time
+#define PEACHOS_DCACHE_MAX_NAME 16
+
+// File contents we cache in pages, shared by every open of the same file (4 MiB)
+#define PEACHOS_PAGECACHE_PAGE_SIZE 4096
+#define PEACHOS_PAGECACHE_MAX_PAGES 1024
+#define PEACHOS_PAGECACHE_BUCKETS 64
+
+// Drives a path can name (0:/ to 9:/), each one a mount of some filesystem
+#define PEACHOS_VFS_MAX_MOUNTS 10
+// Files open at once, every open of the same file shares its inode
+#define PEACHOS_VFS_MAX_INODES 128
+#define PEACHOS_VFS_INODE_BUCKETS 64
+
+// The in-memory filesystem for scratch files is mounted here (9:/), names are case sensitive and up to 15 characters
+// Note: the drive is kept free of disks, so they take 0:/ .. 8:/
+#define PEACHOS_TMPFS_DRIVE 9
+#define PEACHOS_TMPFS_MAX_NAME 16
+
 #define PEACHOS_TOTAL_GDT_SEGMENTS 6
 
 #define PEACHOS_PROGRAM_VIRTUAL_ADDRESS 0x400000
@@ -27,6 +74,11 @@
 #define PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START 0x3FF000
 
 #define PEACHOS_MAX_PROGRAM_ALLOCATIONS 1024
+
+// Files a process maps into memory go to this part of its address space
+#define PEACHOS_MMAP_VIRTUAL_ADDRESS 0x40000000
+#define PEACHOS_MMAP_VIRTUAL_SIZE 0x10000000
+#define PEACHOS_MAX_PROCESS_MAPPINGS 16
 #define PEACHOS_MAX_PROCESSES 12
 
 // Here: we minus (-) it because stack grows downwards
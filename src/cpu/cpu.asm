@@ -0,0 +1,11 @@
+[BITS 32]
+
+section .asm
+
+global cpu_read_tsc
+
+; uint64_t cpu_read_tsc()
+; Note: rdtsc already leaves the counter in edx:eax, which is how 64-bit values are returned
+cpu_read_tsc:
+    rdtsc
+    ret
@@ -0,0 +1,8 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+uint64_t cpu_read_tsc();
+
+#endif
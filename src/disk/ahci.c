@@ -0,0 +1,498 @@
+#include "ahci.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+#define AHCI_GHC_AE 0x80000000
+#define AHCI_CAP_SNCQ 0x40000000
+
+#define AHCI_PORT_CMD_ST 0x0001
+#define AHCI_PORT_CMD_FRE 0x0010
+#define AHCI_PORT_CMD_FR 0x4000
+#define AHCI_PORT_CMD_CR 0x8000
+#define AHCI_PORT_IS_TFES 0x40000000
+
+#define AHCI_SSTS_DET_PRESENT 0x3
+#define AHCI_SSTS_IPM_ACTIVE 0x1
+#define AHCI_SIG_ATA 0x00000101
+
+#define AHCI_FIS_TYPE_REG_H2D 0x27
+#define AHCI_FIS_COMMAND 0x80
+// Command header flag: the data goes from memory to the drive
+#define AHCI_HEADER_WRITE 0x40
+
+#define AHCI_TFD_BSY 0x80
+#define AHCI_TFD_DRQ 0x08
+
+#define AHCI_ATA_READ_DMA_EXT 0x25
+#define AHCI_ATA_READ_FPDMA_QUEUED 0x60
+#define AHCI_ATA_WRITE_DMA_EXT 0x35
+#define AHCI_ATA_FLUSH_CACHE_EXT 0xEA
+#define AHCI_ATA_IDENTIFY 0xEC
+
+// Sector count is 16 bits wide (0 means 65536), which is also what our PRDT can describe
+#define AHCI_MAX_SECTORS_PER_COMMAND 65536
+#define AHCI_COMMAND_SLOTS 32
+
+// How long we spin on the HBA before giving up
+#define AHCI_SPIN_TIMEOUT 10000000
+
+// Private data of a disk that lives on an AHCI port
+struct ahci_private
+{
+    volatile struct ahci_hba_port* port;
+    struct ahci_command_header* command_list;
+    void* fis;
+    struct ahci_command_table* tables;
+
+    // Does the drive (and HBA) support native command queuing
+    int ncq;
+};
+
+// Note: stops the command engine so the command list and FIS area may be changed
+static int ahci_port_stop(volatile struct ahci_hba_port* port)
+{
+    port->cmd &= ~AHCI_PORT_CMD_ST;
+    port->cmd &= ~AHCI_PORT_CMD_FRE;
+
+    for (int spin = 0; spin < AHCI_SPIN_TIMEOUT; spin++)
+    {
+        if (!(port->cmd & (AHCI_PORT_CMD_FR | AHCI_PORT_CMD_CR)))
+        {
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+static int ahci_port_start(volatile struct ahci_hba_port* port)
+{
+    for (int spin = 0; spin < AHCI_SPIN_TIMEOUT; spin++)
+    {
+        if (!(port->cmd & AHCI_PORT_CMD_CR))
+        {
+            port->cmd |= AHCI_PORT_CMD_FRE;
+            port->cmd |= AHCI_PORT_CMD_ST;
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+// Note: waits for the drive to stop being busy before we hand it a command
+static int ahci_port_wait_idle(volatile struct ahci_hba_port* port)
+{
+    for (int spin = 0; spin < AHCI_SPIN_TIMEOUT; spin++)
+    {
+        if (!(port->tfd & (AHCI_TFD_BSY | AHCI_TFD_DRQ)))
+        {
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+// Note: a port is usable when a device is present, the link is up and it signs as an ATA drive
+static int ahci_port_has_drive(volatile struct ahci_hba_port* port)
+{
+    uint32_t ssts = port->ssts;
+    uint8_t det = ssts & 0x0F;
+    uint8_t ipm = (ssts >> 8) & 0x0F;
+    return det == AHCI_SSTS_DET_PRESENT && ipm == AHCI_SSTS_IPM_ACTIVE && port->sig == AHCI_SIG_ATA;
+}
+
+// Note: fills command slot (slot) with an ATA command moving (bytes) between the drive and buf
+static void ahci_build_command(struct ahci_private* private, int slot, uint8_t command, uint64_t lba, int total, void* buf, uint32_t bytes)
+{
+    struct ahci_command_header* header = &private->command_list[slot];
+    struct ahci_command_table* table = &private->tables[slot];
+    memset(table, 0, sizeof(struct ahci_command_table));
+
+    // Here: we split the buffer into physical regions of at most 4 MiB
+    int entries = 0;
+    while (bytes > 0 && entries < AHCI_PRDT_ENTRIES)
+    {
+        uint32_t chunk = bytes > AHCI_PRDT_MAX_BYTES ? AHCI_PRDT_MAX_BYTES : bytes;
+        table->prdt[entries].dba = (uint32_t) buf;
+        table->prdt[entries].dbau = 0;
+        table->prdt[entries].dbc = chunk - 1;
+        buf += chunk;
+        bytes -= chunk;
+        entries++;
+    }
+
+    header->flags = sizeof(struct ahci_fis_reg_h2d) / sizeof(uint32_t);
+    if (command == AHCI_ATA_WRITE_DMA_EXT)
+    {
+        header->flags |= AHCI_HEADER_WRITE;
+    }
+    header->flags2 = 0;
+    header->prdtl = entries;
+    header->prdbc = 0;
+
+    struct ahci_fis_reg_h2d* fis = (struct ahci_fis_reg_h2d*) table->cfis;
+    fis->fis_type = AHCI_FIS_TYPE_REG_H2D;
+    fis->flags = AHCI_FIS_COMMAND;
+    fis->command = command;
+    fis->lba0 = (uint8_t) lba;
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->lba3 = (uint8_t)(lba >> 24);
+    fis->lba4 = (uint8_t)(lba >> 32);
+    fis->lba5 = (uint8_t)(lba >> 40);
+
+    if (command == AHCI_ATA_READ_FPDMA_QUEUED)
+    {
+        // Note: queued commands carry the count in the feature registers and the tag in the count register
+        fis->device = 0x40;
+        fis->feature_low = (uint8_t) total;
+        fis->feature_high = (uint8_t)(total >> 8);
+        fis->count_low = slot << 3;
+    }
+    else
+    {
+        fis->device = command == AHCI_ATA_IDENTIFY || command == AHCI_ATA_FLUSH_CACHE_EXT ? 0 : 0x40;
+        fis->count_low = (uint8_t) total;
+        fis->count_high = (uint8_t)(total >> 8);
+    }
+}
+
+// Note: issues the slots in (mask) and spins until all of them are done
+static int ahci_issue_and_wait(struct ahci_private* private, uint32_t mask, int queued)
+{
+    volatile struct ahci_hba_port* port = private->port;
+    if (ahci_port_wait_idle(port) < 0)
+    {
+        return -EIO;
+    }
+
+    // Here: we clear stale interrupt status, the bits are write one to clear
+    port->is = 0xFFFFFFFF;
+    if (queued)
+    {
+        port->sact = mask;
+    }
+    port->ci = mask;
+
+    for (int spin = 0; spin < AHCI_SPIN_TIMEOUT; spin++)
+    {
+        if (port->is & AHCI_PORT_IS_TFES)
+        {
+            break;
+        }
+
+        // Note: for queued commands ci clears when the drive accepted them, sact when the data is in memory
+        if (!((port->ci | port->sact) & mask))
+        {
+            return 0;
+        }
+    }
+
+    // Here: the port is in an error state (or hung), we restart it so the next command has a chance
+    ahci_port_stop(port);
+    port->serr = 0xFFFFFFFF;
+    port->is = 0xFFFFFFFF;
+    ahci_port_start(port);
+    return -EIO;
+}
+
+// Note: reads any amount of sectors, one non queued DMA command at a time
+static int ahci_read(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    struct ahci_private* private = disk->driver_private;
+    int res = 0;
+    void* bounce = 0;
+
+    // Check: the HBA needs word aligned buffers
+    if ((uint32_t) buf & 1)
+    {
+        bounce = kmalloc(total * disk->sector_size);
+        if (!bounce)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    void* out = bounce ? bounce : buf;
+    uint64_t current = lba;
+    int left = total;
+    while (left > 0)
+    {
+        int count = left > AHCI_MAX_SECTORS_PER_COMMAND ? AHCI_MAX_SECTORS_PER_COMMAND : left;
+        ahci_build_command(private, 0, AHCI_ATA_READ_DMA_EXT, current, count, out, count * disk->sector_size);
+        res = ahci_issue_and_wait(private, 1, 0);
+        if (res < 0)
+        {
+            break;
+        }
+
+        current += count;
+        left -= count;
+        out += count * disk->sector_size;
+    }
+
+    if (bounce)
+    {
+        if (res >= 0)
+        {
+            memcpy(buf, bounce, total * disk->sector_size);
+        }
+        kfree(bounce);
+    }
+
+    return res;
+}
+
+// Note: puts up to queue_depth commands in flight as native queued commands, one tag each
+static int ahci_read_batch(struct disk* disk, struct disk_command* commands, int total)
+{
+    struct ahci_private* private = disk->driver_private;
+    uint32_t mask = 0;
+    int res = 0;
+
+    for (int i = 0; i < total; i++)
+    {
+        struct disk_command* command = &commands[i];
+        if (command->status < 0)
+        {
+            continue;
+        }
+
+        // Check: commands we cannot queue as they are (too big, odd buffer) go the slow way once the batch is done
+        if (!private->ncq || i >= AHCI_COMMAND_SLOTS || command->total > AHCI_MAX_SECTORS_PER_COMMAND || ((uint32_t) command->buf & 1))
+        {
+            continue;
+        }
+
+        ahci_build_command(private, i, AHCI_ATA_READ_FPDMA_QUEUED, command->lba, command->total, command->buf, command->total * disk->sector_size);
+        mask |= 1 << i;
+    }
+
+    if (mask)
+    {
+        int queued_res = ahci_issue_and_wait(private, mask, 1);
+        for (int i = 0; i < total && i < AHCI_COMMAND_SLOTS; i++)
+        {
+            if (mask & (1 << i))
+            {
+                commands[i].status = queued_res;
+            }
+        }
+    }
+
+    // Note: ahci_read builds its commands in slot 0, it must not run while the batch still has a command there
+    for (int i = 0; i < total; i++)
+    {
+        int queued = i < AHCI_COMMAND_SLOTS && (mask & (1 << i));
+        if (!queued && commands[i].status >= 0)
+        {
+            commands[i].status = ahci_read(disk, commands[i].lba, commands[i].total, commands[i].buf);
+        }
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        if (commands[i].status < 0)
+        {
+            res = commands[i].status;
+        }
+    }
+
+    return res;
+}
+
+// Note: writes any amount of sectors one non queued DMA command at a time
+static int ahci_write(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    struct ahci_private* private = disk->driver_private;
+    int res = 0;
+    void* bounce = 0;
+
+    // Check: the HBA needs word aligned buffers
+    if ((uint32_t) buf & 1)
+    {
+        bounce = kmalloc(total * disk->sector_size);
+        if (!bounce)
+        {
+            return -ENOMEM;
+        }
+        memcpy(bounce, buf, total * disk->sector_size);
+    }
+
+    void* in = bounce ? bounce : buf;
+    uint64_t current = lba;
+    int left = total;
+    while (left > 0)
+    {
+        int count = left > AHCI_MAX_SECTORS_PER_COMMAND ? AHCI_MAX_SECTORS_PER_COMMAND : left;
+        ahci_build_command(private, 0, AHCI_ATA_WRITE_DMA_EXT, current, count, in, count * disk->sector_size);
+        res = ahci_issue_and_wait(private, 1, 0);
+        if (res < 0)
+        {
+            break;
+        }
+
+        current += count;
+        left -= count;
+        in += count * disk->sector_size;
+    }
+
+    if (bounce)
+    {
+        kfree(bounce);
+    }
+
+    return res;
+}
+
+// Note: has the drive put its write cache on the media
+static int ahci_flush(struct disk* disk)
+{
+    struct ahci_private* private = disk->driver_private;
+    ahci_build_command(private, 0, AHCI_ATA_FLUSH_CACHE_EXT, 0, 0, 0, 0);
+    return ahci_issue_and_wait(private, 1, 0);
+}
+
+struct disk_driver ahci_driver =
+{
+    .read = ahci_read,
+    .read_batch = ahci_read_batch,
+    .write = ahci_write,
+    .flush = ahci_flush,
+    .name = "AHCI"
+};
+
+// Note: gives the port its own command list, FIS area and command tables and starts it
+static int ahci_port_rebase(struct ahci_private* private)
+{
+    volatile struct ahci_hba_port* port = private->port;
+    if (ahci_port_stop(port) < 0)
+    {
+        return -EIO;
+    }
+
+    // Note: kzalloc hands out 4096 byte aligned blocks, more than the 1K/256/128 byte alignment needed here
+    private->command_list = kzalloc(sizeof(struct ahci_command_header) * AHCI_COMMAND_SLOTS);
+    private->fis = kzalloc(256);
+    private->tables = kzalloc(sizeof(struct ahci_command_table) * AHCI_COMMAND_SLOTS);
+    if (!private->command_list || !private->fis || !private->tables)
+    {
+        return -ENOMEM;
+    }
+
+    port->clb = (uint32_t) private->command_list;
+    port->clbu = 0;
+    port->fb = (uint32_t) private->fis;
+    port->fbu = 0;
+
+    for (int i = 0; i < AHCI_COMMAND_SLOTS; i++)
+    {
+        private->command_list[i].ctba = (uint32_t) &private->tables[i];
+        private->command_list[i].ctbau = 0;
+    }
+
+    port->serr = 0xFFFFFFFF;
+    port->is = 0xFFFFFFFF;
+    return ahci_port_start(port);
+}
+
+// Note: binds the drive on (port) to the disk
+static int ahci_port_attach(struct disk* disk, volatile struct ahci_hba_memory* hba, volatile struct ahci_hba_port* port)
+{
+    int res = 0;
+    uint16_t identify[256];
+    struct ahci_private* private = kzalloc(sizeof(struct ahci_private));
+    if (!private)
+    {
+        return -ENOMEM;
+    }
+
+    private->port = port;
+    res = ahci_port_rebase(private);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    ahci_build_command(private, 0, AHCI_ATA_IDENTIFY, 0, 0, identify, sizeof(identify));
+    res = ahci_issue_and_wait(private, 1, 0);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // Check: we only speak the DMA EXT commands, so the drive must support 48-bit addressing
+    if (!(identify[83] & (1 << 10)))
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    disk->total_sectors = (uint64_t) identify[100] | ((uint64_t) identify[101] << 16) | ((uint64_t) identify[102] << 32) | ((uint64_t) identify[103] << 48);
+    disk->queue_depth = 1;
+
+    // Note: word 76 bit 8 is NCQ support, word 75 the drive queue depth - 1, the HBA tells us its slot count in CAP
+    if ((hba->cap & AHCI_CAP_SNCQ) && (identify[76] & (1 << 8)))
+    {
+        int drive_depth = (identify[75] & 0x1F) + 1;
+        int hba_slots = ((hba->cap >> 8) & 0x1F) + 1;
+        private->ncq = 1;
+        disk->queue_depth = drive_depth < hba_slots ? drive_depth : hba_slots;
+    }
+
+    disk->type = PEACHOS_DISK_TYPE_AHCI;
+    disk->driver = &ahci_driver;
+    disk->driver_private = private;
+
+out:
+    if (res < 0)
+    {
+        ahci_port_stop(port);
+        if (private->command_list)
+            kfree(private->command_list);
+        if (private->fis)
+            kfree(private->fis);
+        if (private->tables)
+            kfree(private->tables);
+        kfree(private);
+    }
+    return res;
+}
+
+// Note: looks for an AHCI controller and binds the first SATA drive on it to the disk
+int ahci_init(struct disk* disk)
+{
+    struct pci_device device;
+    if (pci_find_class(AHCI_PCI_CLASS, AHCI_PCI_SUBCLASS, AHCI_PCI_PROG_IF, 0, &device) < 0)
+    {
+        return -EIO;
+    }
+
+    pci_enable(&device, PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER);
+
+    // Note: ABAR lives in BAR5, the low bits are type information
+    volatile struct ahci_hba_memory* hba = (volatile struct ahci_hba_memory*)(pci_get_bar(&device, 5) & 0xFFFFFFF0);
+    hba->ghc |= AHCI_GHC_AE;
+
+    uint32_t implemented = hba->pi;
+    for (int i = 0; i < 32; i++)
+    {
+        if (!(implemented & (1 << i)) || !ahci_port_has_drive(&hba->ports[i]))
+        {
+            continue;
+        }
+
+        if (ahci_port_attach(disk, hba, &hba->ports[i]) == 0)
+        {
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
@@ -0,0 +1,116 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+// PCI class of an AHCI 1.0 SATA controller
+#define AHCI_PCI_CLASS 0x01
+#define AHCI_PCI_SUBCLASS 0x06
+#define AHCI_PCI_PROG_IF 0x01
+
+// Physical region descriptors per command table, each one covers up to 4 MiB
+#define AHCI_PRDT_ENTRIES 8
+#define AHCI_PRDT_MAX_BYTES 0x400000
+
+// The HBA registers of one port (AHCI 1.3, section 3.3)
+struct ahci_hba_port
+{
+    uint32_t clb;       // Command list base address, 1K aligned
+    uint32_t clbu;
+    uint32_t fb;        // FIS base address, 256 byte aligned
+    uint32_t fbu;
+    uint32_t is;        // Interrupt status
+    uint32_t ie;        // Interrupt enable
+    uint32_t cmd;       // Command and status
+    uint32_t reserved0;
+    uint32_t tfd;       // Task file data
+    uint32_t sig;       // Signature
+    uint32_t ssts;      // SATA status
+    uint32_t sctl;      // SATA control
+    uint32_t serr;      // SATA error
+    uint32_t sact;      // SATA active, one bit per outstanding NCQ tag
+    uint32_t ci;        // Command issue, one bit per command slot
+    uint32_t sntf;
+    uint32_t fbs;
+    uint32_t reserved1[11];
+    uint32_t vendor[4];
+} __attribute__((packed));
+
+// The generic host control registers followed by the 32 ports (AHCI 1.3, section 3.1)
+struct ahci_hba_memory
+{
+    uint32_t cap;       // Host capabilities
+    uint32_t ghc;       // Global host control
+    uint32_t is;
+    uint32_t pi;        // Ports implemented
+    uint32_t vs;
+    uint32_t ccc_ctl;
+    uint32_t ccc_pts;
+    uint32_t em_loc;
+    uint32_t em_ctl;
+    uint32_t cap2;
+    uint32_t bohc;
+    uint8_t reserved[0xA0 - 0x2C];
+    uint8_t vendor[0x100 - 0xA0];
+    struct ahci_hba_port ports[32];
+} __attribute__((packed));
+
+// Register host to device FIS, this is how we hand the drive an ATA command
+struct ahci_fis_reg_h2d
+{
+    uint8_t fis_type;
+    uint8_t flags;      // Bit 7 set: this FIS carries a command
+    uint8_t command;
+    uint8_t feature_low;
+
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+
+    uint8_t reserved[4];
+} __attribute__((packed));
+
+// One of the 32 slots of the command list
+struct ahci_command_header
+{
+    uint8_t flags;      // Bits 0-4: FIS length in dwords, bit 6: write
+    uint8_t flags2;
+    uint16_t prdtl;     // Entries in the physical region descriptor table
+    uint32_t prdbc;     // Bytes transferred so far
+    uint32_t ctba;      // Command table base address, 128 byte aligned
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed));
+
+struct ahci_prdt_entry
+{
+    uint32_t dba;       // Data base address, word aligned
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;       // Bits 0-21: byte count - 1
+} __attribute__((packed));
+
+struct ahci_command_table
+{
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    struct ahci_prdt_entry prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed));
+
+struct disk;
+
+int ahci_init(struct disk* disk);
+
+#endif
@@ -0,0 +1,317 @@
+#include "ata.h"
+#include "disk.h"
+#include "io/io.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// I/O port base of each channel, the registers below are offsets from it
+#define ATA_PRIMARY_BASE 0x1F0
+#define ATA_SECONDARY_BASE 0x170
+
+#define ATA_REG_DATA 0
+#define ATA_REG_SECTOR_COUNT 2
+#define ATA_REG_LBA_LOW 3
+#define ATA_REG_LBA_MID 4
+#define ATA_REG_LBA_HIGH 5
+#define ATA_REG_DRIVE_SELECT 6
+#define ATA_REG_COMMAND 7
+#define ATA_REG_STATUS 7
+
+// Drive select bits: LBA addressing, and which drive of the channel
+#define ATA_SELECT_LBA 0x40
+#define ATA_SELECT_SLAVE 0x10
+
+// Status register bits
+#define ATA_STATUS_ERR 0x01
+#define ATA_STATUS_DRQ 0x08
+#define ATA_STATUS_DF 0x20
+#define ATA_STATUS_BSY 0x80
+
+#define ATA_COMMAND_READ_SECTORS 0x20
+#define ATA_COMMAND_READ_SECTORS_EXT 0x24
+#define ATA_COMMAND_WRITE_SECTORS 0x30
+#define ATA_COMMAND_WRITE_SECTORS_EXT 0x34
+#define ATA_COMMAND_CACHE_FLUSH 0xE7
+#define ATA_COMMAND_CACHE_FLUSH_EXT 0xEA
+#define ATA_COMMAND_IDENTIFY 0xEC
+
+// How long we spin on the drive before giving up
+#define ATA_SPIN_TIMEOUT 10000000
+
+// Private data of an ATA PIO disk
+struct ata_private
+{
+    // I/O port base of the channel the drive sits on
+    uint16_t base;
+    // ATA_SELECT_SLAVE for the slave drive, 0 for the master
+    uint8_t select;
+
+    // Does the drive accept 48-bit LBA commands (READ SECTORS EXT)
+    bool lba48;
+};
+
+// Note: waits until the drive has a sector ready for us (or reports an error)
+static int ata_wait_drq(struct ata_private* private)
+{
+    int spin = 0;
+    unsigned char c = insb(private->base + ATA_REG_STATUS);
+    while((c & ATA_STATUS_BSY) || !(c & (ATA_STATUS_DRQ | ATA_STATUS_ERR | ATA_STATUS_DF)))
+    {
+        if (++spin >= ATA_SPIN_TIMEOUT)
+        {
+            return -EIO;
+        }
+        c = insb(private->base + ATA_REG_STATUS);
+    }
+
+    if (c & (ATA_STATUS_ERR | ATA_STATUS_DF))
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+// Note: copies (total) sectors of the command that was just issued from the data port into buf
+static int ata_read_pio_data(struct ata_private* private, int total, void* buf)
+{
+    unsigned short* ptr = (unsigned short*) buf;
+    for (int b = 0; b < total; b++)
+    {
+        // Wait for the buffer to be ready
+        if (ata_wait_drq(private) < 0)
+        {
+            return -EIO;
+        }
+
+        // Copy from hard disk to memory
+        for (int i = 0; i < 256; i++)
+        {
+            *ptr = insw(private->base + ATA_REG_DATA);
+            ptr++;
+        }
+    }
+
+    return 0;
+}
+
+// Note: copies (total) sectors from buf to the data port for the command that was just issued
+static int ata_write_pio_data(struct ata_private* private, int total, void* buf)
+{
+    unsigned short* ptr = (unsigned short*) buf;
+    for (int b = 0; b < total; b++)
+    {
+        // Wait for the drive to ask for the sector
+        if (ata_wait_drq(private) < 0)
+        {
+            return -EIO;
+        }
+
+        for (int i = 0; i < 256; i++)
+        {
+            outw(private->base + ATA_REG_DATA, *ptr);
+            ptr++;
+        }
+    }
+
+    return 0;
+}
+
+// Note: waits until the drive is done with the last command, e.g. the sectors of a write are on the platter
+static int ata_wait_idle(struct ata_private* private)
+{
+    int spin = 0;
+    unsigned char c = insb(private->base + ATA_REG_STATUS);
+    while (c & ATA_STATUS_BSY)
+    {
+        if (++spin >= ATA_SPIN_TIMEOUT)
+        {
+            return -EIO;
+        }
+        c = insb(private->base + ATA_REG_STATUS);
+    }
+
+    return c & (ATA_STATUS_ERR | ATA_STATUS_DF) ? -EIO : 0;
+}
+
+// Note: issues (command) with a 28-bit LBA, total must be 1..256 (256 is sent as 0)
+static void ata_issue_lba28(struct ata_private* private, uint32_t lba, int total, uint8_t command)
+{
+    uint16_t base = private->base;
+    outb(base + ATA_REG_DRIVE_SELECT, (lba >> 24) | 0xE0 | private->select);
+    outb(base + ATA_REG_SECTOR_COUNT, (unsigned char) total);
+    outb(base + ATA_REG_LBA_LOW, (unsigned char)(lba & 0xff));
+    outb(base + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));
+    outb(base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));
+    outb(base + ATA_REG_COMMAND, command);
+}
+
+// Note: issues (command) with a 48-bit LBA, total must be 1..65536 (65536 is sent as 0)
+// Note: every register is written twice, the high order byte goes first
+static void ata_issue_lba48(struct ata_private* private, uint64_t lba, int total, uint8_t command)
+{
+    uint16_t base = private->base;
+    outb(base + ATA_REG_DRIVE_SELECT, ATA_SELECT_LBA | private->select);
+    outb(base + ATA_REG_SECTOR_COUNT, (unsigned char)(total >> 8));
+    outb(base + ATA_REG_LBA_LOW, (unsigned char)(lba >> 24));
+    outb(base + ATA_REG_LBA_MID, (unsigned char)(lba >> 32));
+    outb(base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 40));
+    outb(base + ATA_REG_SECTOR_COUNT, (unsigned char) total);
+    outb(base + ATA_REG_LBA_LOW, (unsigned char) lba);
+    outb(base + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));
+    outb(base + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));
+    outb(base + ATA_REG_COMMAND, command);
+}
+
+// Note: moves any amount of sectors in or out, splitting it into as few commands as the drive allows
+static int ata_transfer(struct disk* idisk, uint64_t lba, int total, void* buf, int write)
+{
+    struct ata_private* private = idisk->driver_private;
+    int res = 0;
+    while (total > 0)
+    {
+        int max = private->lba48 ? PEACHOS_DISK_LBA48_MAX_SECTORS : PEACHOS_DISK_LBA28_MAX_SECTORS;
+        int count = total > max ? max : total;
+
+        // Note: small requests below the 28-bit boundary keep using the commands every drive supports
+        if (count <= PEACHOS_DISK_LBA28_MAX_SECTORS && lba + count <= PEACHOS_DISK_LBA28_LIMIT)
+        {
+            ata_issue_lba28(private, (uint32_t) lba, count, write ? ATA_COMMAND_WRITE_SECTORS : ATA_COMMAND_READ_SECTORS);
+        }
+        else if (private->lba48)
+        {
+            ata_issue_lba48(private, lba, count, write ? ATA_COMMAND_WRITE_SECTORS_EXT : ATA_COMMAND_READ_SECTORS_EXT);
+        }
+        else
+        {
+            res = -EIO;
+            break;
+        }
+
+        res = write ? ata_write_pio_data(private, count, buf) : ata_read_pio_data(private, count, buf);
+
+        // Note: the drive is busy while it takes the last sector of a write, commands written then are ignored
+        if (res >= 0 && write)
+        {
+            res = ata_wait_idle(private);
+        }
+        if (res < 0)
+        {
+            break;
+        }
+
+        lba += count;
+        total -= count;
+        buf += count * idisk->sector_size;
+    }
+
+    return res;
+}
+
+static int ata_read(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    return ata_transfer(idisk, lba, total, buf, 0);
+}
+
+static int ata_write(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    return ata_transfer(idisk, lba, total, buf, 1);
+}
+
+// Note: has the drive put its write cache on the platter, until then written sectors may only be in the drive's memory
+static int ata_flush(struct disk* idisk)
+{
+    struct ata_private* private = idisk->driver_private;
+    outb(private->base + ATA_REG_DRIVE_SELECT, 0xE0 | private->select);
+    outb(private->base + ATA_REG_COMMAND, private->lba48 ? ATA_COMMAND_CACHE_FLUSH_EXT : ATA_COMMAND_CACHE_FLUSH);
+    return ata_wait_idle(private);
+}
+
+// Note: asks the drive who it is, so we know it exists, its size and if it speaks LBA48
+static int ata_identify(struct disk* idisk, struct ata_private* private)
+{
+    uint16_t identify[256];
+    uint16_t base = private->base;
+
+    outb(base + ATA_REG_DRIVE_SELECT, 0xA0 | private->select);
+    outb(base + ATA_REG_SECTOR_COUNT, 0);
+    outb(base + ATA_REG_LBA_LOW, 0);
+    outb(base + ATA_REG_LBA_MID, 0);
+    outb(base + ATA_REG_LBA_HIGH, 0);
+    outb(base + ATA_REG_COMMAND, ATA_COMMAND_IDENTIFY);
+
+    // Check: status of zero means there is no drive, all ones means there is not even a channel
+    unsigned char status = insb(base + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF)
+    {
+        return -EIO;
+    }
+
+    for (int spin = 0; status & ATA_STATUS_BSY; spin++)
+    {
+        if (spin >= ATA_SPIN_TIMEOUT)
+        {
+            return -EIO;
+        }
+        status = insb(base + ATA_REG_STATUS);
+    }
+
+    // Check: ATAPI and SATA drives put their signature in the LBA registers, we only speak to plain ATA
+    if (insb(base + ATA_REG_LBA_MID) || insb(base + ATA_REG_LBA_HIGH))
+    {
+        return -EIO;
+    }
+
+    if (ata_read_pio_data(private, 1, identify) < 0)
+    {
+        return -EIO;
+    }
+
+    // Note: word 83 bit 10 tells us about the 48-bit feature set, words 100-103 hold its sector count
+    if (identify[83] & (1 << 10))
+    {
+        private->lba48 = true;
+        idisk->total_sectors = (uint64_t) identify[100] | ((uint64_t) identify[101] << 16) | ((uint64_t) identify[102] << 32) | ((uint64_t) identify[103] << 48);
+    }
+    else
+    {
+        idisk->total_sectors = (uint32_t) identify[60] | ((uint32_t) identify[61] << 16);
+    }
+
+    return 0;
+}
+
+struct disk_driver ata_driver =
+{
+    .read = ata_read,
+    .write = ata_write,
+    .flush = ata_flush,
+    .name = "ATA PIO"
+};
+
+// Note: binds drive (drive) of channel (channel) to the disk, if there is one
+int ata_init(struct disk* idisk, int channel, int drive)
+{
+    struct ata_private* private = kzalloc(sizeof(struct ata_private));
+    if (!private)
+    {
+        return -ENOMEM;
+    }
+
+    private->base = channel == 0 ? ATA_PRIMARY_BASE : ATA_SECONDARY_BASE;
+    private->select = drive == 0 ? 0 : ATA_SELECT_SLAVE;
+    if (ata_identify(idisk, private) < 0)
+    {
+        kfree(private);
+        return -EIO;
+    }
+
+    idisk->type = PEACHOS_DISK_TYPE_REAL;
+    idisk->driver = &ata_driver;
+    idisk->driver_private = private;
+    // Note: PIO serves one command at a time
+    idisk->queue_depth = 1;
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef ATA_H
+#define ATA_H
+
+// Legacy IDE: a primary and a secondary channel, each with a master and a slave drive
+#define ATA_TOTAL_CHANNELS 2
+#define ATA_DRIVES_PER_CHANNEL 2
+
+struct disk;
+
+int ata_init(struct disk* disk, int channel, int drive);
+
+#endif
@@ -1,65 +1,324 @@
 #include "disk.h"
-#include "io/io.h"
+#include "ata.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "nvme.h"
+#include "partition.h"
+#include "ramdisk.h"
 #include "config.h"
 #include "status.h"
+#include "cpu/cpu.h"
 #include "memory/memory.h"
+#include "memory/heap/kheap.h"
 
-struct disk disk;
+// Every disk and partition we found, the index is the drive number used in paths
+static struct disk* disks[PEACHOS_MAX_DISKS];
+static int total_disks = 0;
 
-int disk_read_sector(int lba, int total, void* buf)
+// Note: an empty disk, the driver init fills in the rest
+struct disk* disk_new()
 {
-    outb(0x1F6, (lba >> 24) | 0xE0);
-    outb(0x1F2, total);
-    outb(0x1F3, (unsigned char)(lba & 0xff));
-    outb(0x1F4, (unsigned char)(lba >> 8));
-    outb(0x1F5, (unsigned char)(lba >> 16));
-    outb(0x1F7, 0x20);
+    struct disk* idisk = kzalloc(sizeof(struct disk));
+    if (!idisk)
+    {
+        return 0;
+    }
+
+    idisk->sector_size = PEACHOS_SECTOR_SIZE;
+    diskqueue_init(&idisk->queue);
+    return idisk;
+}
+
+// Note: hands the disk the next free drive number, the tmpfs drive is never handed out
+int disk_register(struct disk* idisk)
+{
+    if (total_disks >= PEACHOS_MAX_DISKS || total_disks == PEACHOS_TMPFS_DRIVE)
+    {
+        return -EISTKN;
+    }
+
+    idisk->id = total_disks;
+    disks[total_disks++] = idisk;
+    return idisk->id;
+}
+
+// Note: registers a disk a driver bound successfully, a disk without a filesystem of its own may still hold partitions
+static void disk_add(struct disk* idisk)
+{
+    if (disk_register(idisk) < 0)
+    {
+        return;
+    }
 
-    unsigned short* ptr = (unsigned short*) buf;
-    for (int b = 0; b < total; b++)
+    idisk->filesystem = fs_resolve(idisk);
+    if (!idisk->filesystem)
+    {
+        partition_scan_mbr(idisk);
+    }
+}
+
+// Note: loads the boot disk (drive 0) into memory, the RAM copy takes over 0:/ and the disk itself moves to the next free number
+static void disk_load_ramdisk()
+{
+    struct disk* source = disk_get(0);
+    if (!source || !source->filesystem || total_disks >= PEACHOS_MAX_DISKS)
+    {
+        return;
+    }
+
+    struct disk* ramdisk = ramdisk_load(source);
+    if (!ramdisk)
+    {
+        return;
+    }
+
+    source->id = total_disks;
+    disks[total_disks++] = source;
+    ramdisk->id = 0;
+    disks[0] = ramdisk;
+    ramdisk->filesystem = fs_resolve(ramdisk);
+
+    // Note: writes to 0:/ go through to the source, its own filesystem instance would not see them. It stays readable
+    // but is not written through its own drive number, so the two instances never both change the same sectors
+    source->read_only = true;
+}
+
+// Note: probes every controller we know, fastest first, so the fastest disk (usually the one we booted from) becomes 0:/
+// Note: NVMe, virtio-blk and AHCI attach their first drive, legacy IDE is probed on both channels, master and slave
+void disk_search_and_init()
+{
+    DISK_INIT_FUNCTION controllers[] = { nvme_init, virtio_blk_init, ahci_init };
+    for (int i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++)
     {
-        // Wait for the buffer to be ready
-        char c = insb(0x1F7);
-        while(!(c & 0x08))
+        struct disk* idisk = disk_new();
+        if (!idisk)
         {
-            c = insb(0x1F7);
+            return;
         }
 
-        // Copy from hard disk to memory
-        for (int i = 0; i < 256; i++)
+        if (controllers[i](idisk) < 0)
         {
-            *ptr = insw(0x1F0);
-            ptr++;
+            kfree(idisk);
+            continue;
         }
+        disk_add(idisk);
+    }
+
+    for (int channel = 0; channel < ATA_TOTAL_CHANNELS; channel++)
+    {
+        for (int drive = 0; drive < ATA_DRIVES_PER_CHANNEL; drive++)
+        {
+            struct disk* idisk = disk_new();
+            if (!idisk)
+            {
+                return;
+            }
 
+            if (ata_init(idisk, channel, drive) < 0)
+            {
+                kfree(idisk);
+                continue;
+            }
+            disk_add(idisk);
+        }
+    }
+
+    if (PEACHOS_RAMDISK_ENABLED)
+    {
+        disk_load_ramdisk();
     }
+}
+
+struct disk* disk_get(int index)
+{
+    if (index < 0 || index >= total_disks)
+        return 0;
+
+    return disks[index];
+}
+
+// Note: copies the stats of disk (index) and stamps the copy with the current TSC, so callers can turn two copies into rates
+int disk_get_stats(int index, struct disk_stats* stats_out)
+{
+    struct disk* idisk = disk_get(index);
+    if (!idisk)
+    {
+        return -EINVARG;
+    }
+
+    memcpy(stats_out, &idisk->stats, sizeof(struct disk_stats));
+    stats_out->timestamp = cpu_read_tsc();
     return 0;
 }
 
-// the disk structure is created on the stack when we created it on line 7.
-void disk_search_and_init()
+static int disk_latency_bucket(uint64_t latency)
 {
-    memset(&disk, 0, sizeof(disk));
-    disk.type = PEACHOS_DISK_TYPE_REAL;
-    disk.sector_size = PEACHOS_SECTOR_SIZE;
-    disk.id = 0;
-    disk.filesystem = fs_resolve(&disk);
+    int bucket = 0;
+    while (latency >>= 1)
+    {
+        bucket++;
+    }
+
+    return bucket < PEACHOS_DISK_LATENCY_BUCKETS ? bucket : PEACHOS_DISK_LATENCY_BUCKETS - 1;
 }
 
-struct disk* disk_get(int index)
+static void disk_account(struct disk* idisk, struct disk_command* command, uint64_t latency)
+{
+    idisk->stats.commands++;
+    idisk->stats.latency_histogram[disk_latency_bucket(latency)]++;
+    if (command->status < 0)
+    {
+        idisk->stats.errors++;
+        return;
+    }
+
+    idisk->stats.sectors += command->total;
+    idisk->stats.bytes += (uint64_t) command->total * idisk->sector_size;
+}
+
+// Note: hands a batch of commands to the driver, drivers that cannot queue get them one after another
+// Note: a batch completes as a whole, so every command of it is accounted with the latency of the batch
+int disk_driver_read_batch(struct disk* idisk, struct disk_command* commands, int total)
 {
-    if (index != 0)
+    int res = 0;
+    if (idisk->driver->read_batch)
+    {
+        uint64_t start = cpu_read_tsc();
+        res = idisk->driver->read_batch(idisk, commands, total);
+        uint64_t latency = cpu_read_tsc() - start;
+
+        idisk->stats.busy_time += latency;
+        for (int i = 0; i < total; i++)
+        {
+            disk_account(idisk, &commands[i], latency);
+        }
+        return res;
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        // Check: the command may have failed before it got to us
+        if (commands[i].status < 0)
+        {
+            res = commands[i].status;
+            continue;
+        }
+
+        uint64_t start = cpu_read_tsc();
+        commands[i].status = idisk->driver->read(idisk, commands[i].lba, commands[i].total, commands[i].buf);
+        uint64_t latency = cpu_read_tsc() - start;
+
+        idisk->stats.busy_time += latency;
+        disk_account(idisk, &commands[i], latency);
+        if (commands[i].status < 0)
+        {
+            res = commands[i].status;
+        }
+    }
+
+    return res;
+}
+
+int disk_read_block(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    if (!idisk || !idisk->driver)
+    {
+        return -EIO;
+    }
+
+    // Here: a synchronous read is just a request we wait for straight away
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.lba = lba;
+    request.total = total;
+    request.buf = buf;
+
+    int res = diskqueue_submit(idisk, &request);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    return diskqueue_wait(idisk, &request);
+}
+
+// Note: a disk takes writes when its driver can write and it was not made read only
+bool disk_is_read_only(struct disk* idisk)
+{
+    return !idisk->driver || !idisk->driver->write || idisk->read_only;
+}
+
+// Note: hands a write to the driver, stacked disks use it to write through to the disk below them
+int disk_driver_write(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    if (!idisk->driver->write)
+    {
+        return -ERDONLY;
+    }
+
+    struct disk_command command;
+    command.lba = lba;
+    command.total = total;
+    command.buf = buf;
+
+    uint64_t start = cpu_read_tsc();
+    command.status = idisk->driver->write(idisk, lba, total, buf);
+    uint64_t latency = cpu_read_tsc() - start;
+
+    idisk->stats.busy_time += latency;
+    disk_account(idisk, &command, latency);
+    return command.status;
+}
+
+/* Note: writes (total) sectors from (buf) at (lba) and returns once the drive has them, they may still be in its cache
+until disk_flush. Writes do not go through the elevator: reads queued before are dispatched first, so they still see
+what was on disk when they were submitted */
+int disk_write_block(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    if (!idisk || !idisk->driver)
+    {
+        return -EIO;
+    }
+
+    if (disk_is_read_only(idisk))
+    {
+        return -ERDONLY;
+    }
+
+    // Check: a write never goes past the end of the disk, when we know where that is
+    if (total <= 0 || !buf || (idisk->total_sectors && lba + total > idisk->total_sectors))
+    {
+        return -EINVARG;
+    }
+
+    diskqueue_run(idisk);
+    return disk_driver_write(idisk, lba, total, buf);
+}
+
+// Note: hands a flush to the driver, stacked disks use it to flush the disk below them
+int disk_driver_flush(struct disk* idisk)
+{
+    if (!idisk->driver->flush)
+    {
         return 0;
-    
-    return &disk;
+    }
+
+    return idisk->driver->flush(idisk);
 }
 
-int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf)
+/* Note: returns once everything written to the disk is on the media. Drivers do not flush after every write, a flush
+costs as much as the writes it covers, so callers ask for one where they need their data to survive a power loss */
+int disk_flush(struct disk* idisk)
 {
-    if (idisk != &disk)
+    if (!idisk || !idisk->driver)
     {
         return -EIO;
     }
 
-    return disk_read_sector(lba, total, buf);
-}
\ No newline at end of file
+    if (disk_is_read_only(idisk))
+    {
+        return 0;
+    }
+
+    return disk_driver_flush(idisk);
+}
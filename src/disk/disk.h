@@ -1,22 +1,108 @@
 #ifndef DISK_H
 #define DISK_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "fs/file.h"
+#include "queue.h"
+#include "config.h"
 
 typedef unsigned int PEACHOS_DISK_TYPE;
 
 
 // Represents a real physical hard disk
 #define PEACHOS_DISK_TYPE_REAL 0
+// A SATA drive behind an AHCI controller
+#define PEACHOS_DISK_TYPE_AHCI 1
+// A paravirtual virtio block device
+#define PEACHOS_DISK_TYPE_VIRTIO 2
+// A namespace of an NVMe controller
+#define PEACHOS_DISK_TYPE_NVME 3
+// A primary partition of another disk
+#define PEACHOS_DISK_TYPE_PARTITION 4
+// A copy of another disk held in memory
+#define PEACHOS_DISK_TYPE_RAM 5
+// No sectors at all, it only carries a tmpfs (see tmpfs_mount)
+#define PEACHOS_DISK_TYPE_TMPFS 6
+
+struct disk;
+
+// One command of a batch handed to a driver
+struct disk_command
+{
+    uint64_t lba;
+    int total;
+    void* buf;
+
+    // Set by the driver once the command is done
+    int status;
+};
+
+typedef int (*DISK_READ_FUNCTION)(struct disk* disk, uint64_t lba, int total, void* buf);
+typedef int (*DISK_READ_BATCH_FUNCTION)(struct disk* disk, struct disk_command* commands, int total);
+typedef int (*DISK_WRITE_FUNCTION)(struct disk* disk, uint64_t lba, int total, void* buf);
+typedef int (*DISK_FLUSH_FUNCTION)(struct disk* disk);
+// Binds the first drive of a controller to the disk
+typedef int (*DISK_INIT_FUNCTION)(struct disk* disk);
+
+struct disk_driver
+{
+    // Reads (total) sectors, the driver splits it into as many commands as it needs
+    DISK_READ_FUNCTION read;
+    // Optional: keeps up to queue_depth commands in flight at once, e.g. with native command queuing
+    DISK_READ_BATCH_FUNCTION read_batch;
+    // Optional: writes (total) sectors and returns once the drive has them, without it the disk is read only
+    DISK_WRITE_FUNCTION write;
+    // Optional: returns once what was written is on the media, a disk without it writes through
+    DISK_FLUSH_FUNCTION flush;
+
+    char name[20];
+};
+
+// What the drivers of a disk did so far, taken around every driver call
+struct disk_stats
+{
+    // Commands handed to the driver, and what they read or wrote
+    uint64_t commands;
+    uint64_t sectors;
+    uint64_t bytes;
+    // Commands the driver failed
+    uint64_t errors;
+
+    // TSC cycles spent inside the driver, for our polling drivers that is time spent busy waiting
+    uint64_t busy_time;
+    uint32_t latency_histogram[PEACHOS_DISK_LATENCY_BUCKETS];
+
+    // TSC at the time this copy was taken, set by disk_get_stats
+    uint64_t timestamp;
+};
 
 struct disk
 {
     PEACHOS_DISK_TYPE type; // unsigned integer as we can see
     int sector_size;
 
-    // The id of the disk
+    // The id of the disk, this is also its drive number in paths (0:/, 1:/, ...)
     int id;
 
+    // Total addressable sectors reported by the drive (0 if unknown)
+    uint64_t total_sectors;
+
+    // The driver that talks to the drive, and its private data
+    struct disk_driver* driver;
+    void* driver_private;
+
+    // How many commands the driver accepts in one batch
+    int queue_depth;
+
+    // Refuse writes even though the driver has a write function, e.g. a disk only written through a RAM copy of it
+    bool read_only;
+
+    // Pending block requests of this disk
+    struct disk_queue queue;
+
+    struct disk_stats stats;
+
     struct filesystem* filesystem;
 
     // The private data of our filesystem
@@ -24,7 +110,18 @@ struct disk
 };
 
 void disk_search_and_init();
+struct disk* disk_new();
+int disk_register(struct disk* idisk);
 struct disk* disk_get(int index);
-int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_get_stats(int index, struct disk_stats* stats_out);
+int disk_read_block(struct disk* idisk, uint64_t lba, int total, void* buf);
+int disk_write_block(struct disk* idisk, uint64_t lba, int total, void* buf);
+int disk_flush(struct disk* idisk);
+bool disk_is_read_only(struct disk* idisk);
+
+// Note: talk to the driver directly, everyone else should go through disk_read_block, disk_write_block or the disk queue
+int disk_driver_read_batch(struct disk* idisk, struct disk_command* commands, int total);
+int disk_driver_write(struct disk* idisk, uint64_t lba, int total, void* buf);
+int disk_driver_flush(struct disk* idisk);
 
-#endif
\ No newline at end of file
+#endif
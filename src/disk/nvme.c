@@ -0,0 +1,674 @@
+#include "nvme.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+#define NVME_CC_EN 0x00000001
+// Submission entries are 2^6 bytes, completion entries 2^4 bytes
+#define NVME_CC_IOSQES (6 << 16)
+#define NVME_CC_IOCQES (4 << 20)
+#define NVME_CSTS_RDY 0x00000001
+#define NVME_CSTS_CFS 0x00000002
+
+#define NVME_ADMIN_CREATE_IO_SQ 0x01
+#define NVME_ADMIN_CREATE_IO_CQ 0x05
+#define NVME_ADMIN_IDENTIFY 0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+#define NVME_IO_FLUSH 0x00
+#define NVME_IO_WRITE 0x01
+#define NVME_IO_READ 0x02
+
+#define NVME_IDENTIFY_NAMESPACE 0x00
+#define NVME_IDENTIFY_CONTROLLER 0x01
+#define NVME_FEATURE_NUMBER_OF_QUEUES 0x07
+#define NVME_QUEUE_PHYSICALLY_CONTIGUOUS 0x01
+
+// We always run the controller with 4096 byte memory pages
+#define NVME_PAGE_SIZE 4096
+#define NVME_PRP_LIST_ENTRIES (NVME_PAGE_SIZE / sizeof(uint64_t))
+// One PRP list page describes 2 MiB, so that is the most a single read asks for
+#define NVME_MAX_SECTORS_PER_COMMAND (NVME_PRP_LIST_ENTRIES * NVME_PAGE_SIZE / PEACHOS_SECTOR_SIZE)
+
+// How long we spin on the controller before giving up
+#define NVME_SPIN_TIMEOUT 100000000
+
+// One submission queue and the completion queue it reports to
+struct nvme_queue
+{
+    uint16_t id;
+    uint16_t entries;
+    volatile struct nvme_command* sq;
+    volatile struct nvme_completion* cq;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    // Phase tag that marks a completion entry as new, it flips every time the queue wraps
+    uint16_t phase;
+
+    // Commands submitted since the queue was last drained, command ids are handed out 0..submitted-1
+    int submitted;
+    int outstanding;
+    uint16_t status[NVME_IO_QUEUE_ENTRIES];
+    uint32_t result;
+
+    // Index of the batch command each command id belongs to
+    int owners[NVME_IO_QUEUE_ENTRIES];
+    // One PRP list page per command id (I/O queues only)
+    uint64_t* prp_lists;
+};
+
+// Private data of an NVMe namespace
+struct nvme_private
+{
+    volatile struct nvme_registers* registers;
+    uint32_t doorbell_stride;
+    uint32_t nsid;
+    int max_sectors;
+
+    struct nvme_queue admin;
+    int total_io_queues;
+    struct nvme_queue io[NVME_IO_QUEUE_PAIRS];
+};
+
+static int nvme_wait_ready(volatile struct nvme_registers* registers, int ready)
+{
+    for (int spin = 0; spin < NVME_SPIN_TIMEOUT; spin++)
+    {
+        if (registers->csts & NVME_CSTS_CFS)
+        {
+            return -EIO;
+        }
+
+        if (((registers->csts & NVME_CSTS_RDY) != 0) == ready)
+        {
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+// Note: allocates the rings of queue (id), doorbells sit after the registers, submission tail first then completion head
+static int nvme_queue_init(struct nvme_private* private, struct nvme_queue* queue, uint16_t id, uint16_t entries)
+{
+    memset(queue, 0, sizeof(struct nvme_queue));
+    queue->id = id;
+    queue->entries = entries;
+    queue->phase = 1;
+
+    // Note: kzalloc hands out 4096 byte aligned memory, queues must start on a page
+    queue->sq = kzalloc(sizeof(struct nvme_command) * entries);
+    queue->cq = kzalloc(sizeof(struct nvme_completion) * entries);
+    if (!queue->sq || !queue->cq)
+    {
+        return -ENOMEM;
+    }
+
+    void* doorbells = (void*) private->registers + 0x1000;
+    queue->sq_doorbell = doorbells + (2 * id) * private->doorbell_stride;
+    queue->cq_doorbell = doorbells + (2 * id + 1) * private->doorbell_stride;
+    return 0;
+}
+
+static void nvme_queue_free(struct nvme_queue* queue)
+{
+    if (queue->sq)
+        kfree((void*) queue->sq);
+    if (queue->cq)
+        kfree((void*) queue->cq);
+    if (queue->prp_lists)
+        kfree(queue->prp_lists);
+}
+
+// Note: copies the command into the submission ring, the controller does not see it until the doorbell is rung
+static int nvme_queue_submit(struct nvme_queue* queue, struct nvme_command* command)
+{
+    int command_id = queue->submitted;
+    command->command_id = command_id;
+    queue->sq[queue->sq_tail] = *command;
+    queue->sq_tail = (queue->sq_tail + 1) % queue->entries;
+    queue->status[command_id] = 0;
+    queue->submitted++;
+    queue->outstanding++;
+    return command_id;
+}
+
+static void nvme_queue_ring(struct nvme_queue* queue)
+{
+    *queue->sq_doorbell = queue->sq_tail;
+}
+
+// Note: consumes every new completion entry and tells the controller how far we got with one doorbell write
+static void nvme_queue_poll(struct nvme_queue* queue)
+{
+    int reaped = 0;
+    while ((queue->cq[queue->cq_head].status & 1) == queue->phase)
+    {
+        volatile struct nvme_completion* completion = &queue->cq[queue->cq_head];
+        if (completion->command_id < NVME_IO_QUEUE_ENTRIES)
+        {
+            queue->status[completion->command_id] = completion->status >> 1;
+        }
+        queue->result = completion->result;
+
+        queue->cq_head++;
+        if (queue->cq_head == queue->entries)
+        {
+            queue->cq_head = 0;
+            queue->phase ^= 1;
+        }
+
+        queue->outstanding--;
+        reaped++;
+    }
+
+    if (reaped)
+    {
+        *queue->cq_doorbell = queue->cq_head;
+    }
+}
+
+// Note: spins until everything submitted to the queue has completed
+static int nvme_queue_wait(struct nvme_queue* queue)
+{
+    for (int spin = 0; spin < NVME_SPIN_TIMEOUT; spin++)
+    {
+        nvme_queue_poll(queue);
+        if (queue->outstanding <= 0)
+        {
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+// Note: runs one admin command to completion, result gets dword 0 of the completion
+static int nvme_admin_command(struct nvme_private* private, struct nvme_command* command, uint32_t* result)
+{
+    struct nvme_queue* admin = &private->admin;
+    admin->submitted = 0;
+    int command_id = nvme_queue_submit(admin, command);
+    nvme_queue_ring(admin);
+
+    if (nvme_queue_wait(admin) < 0 || admin->status[command_id] != 0)
+    {
+        return -EIO;
+    }
+
+    if (result)
+    {
+        *result = admin->result;
+    }
+    return 0;
+}
+
+static int nvme_identify(struct nvme_private* private, uint32_t cns, uint32_t nsid, void* buf)
+{
+    struct nvme_command command;
+    memset(&command, 0, sizeof(command));
+    command.opcode = NVME_ADMIN_IDENTIFY;
+    command.nsid = nsid;
+    command.prp1 = (uint32_t) buf;
+    command.cdw10 = cns;
+    return nvme_admin_command(private, &command, 0);
+}
+
+// Note: describes (bytes) at buf with PRP entries, anything over two pages goes through the command's PRP list
+static void nvme_build_prps(struct nvme_command* command, uint64_t* list, void* buf, uint32_t bytes)
+{
+    uint32_t address = (uint32_t) buf;
+    uint32_t first = NVME_PAGE_SIZE - (address & (NVME_PAGE_SIZE - 1));
+    command->prp1 = address;
+    command->prp2 = 0;
+    if (bytes <= first)
+    {
+        return;
+    }
+
+    bytes -= first;
+    address += first;
+    if (bytes <= NVME_PAGE_SIZE)
+    {
+        command->prp2 = address;
+        return;
+    }
+
+    int entries = 0;
+    while (bytes > 0)
+    {
+        list[entries++] = address;
+        address += NVME_PAGE_SIZE;
+        bytes = bytes > NVME_PAGE_SIZE ? bytes - NVME_PAGE_SIZE : 0;
+    }
+    command->prp2 = (uint32_t) list;
+}
+
+// Note: queues a read or write (opcode) of (total) sectors at (lba) for batch command (owner)
+static void nvme_queue_io(struct nvme_private* private, struct nvme_queue* queue, uint8_t opcode, int owner, uint64_t lba, int total, void* buf)
+{
+    struct nvme_command command;
+    memset(&command, 0, sizeof(command));
+    command.opcode = opcode;
+    command.nsid = private->nsid;
+    command.cdw10 = (uint32_t) lba;
+    command.cdw11 = (uint32_t)(lba >> 32);
+    command.cdw12 = total - 1;
+
+    // Note: the PRP list page belongs to the command id this command is about to get
+    uint64_t* list = queue->prp_lists + queue->submitted * NVME_PRP_LIST_ENTRIES;
+    nvme_build_prps(&command, list, buf, total * PEACHOS_SECTOR_SIZE);
+
+    queue->owners[queue->submitted] = owner;
+    nvme_queue_submit(queue, &command);
+}
+
+// Note: rings every I/O queue that has new commands, then reaps them all, the queues work in parallel meanwhile
+static void nvme_flush(struct nvme_private* private, struct disk_command* commands)
+{
+    for (int i = 0; i < private->total_io_queues; i++)
+    {
+        if (private->io[i].submitted)
+        {
+            nvme_queue_ring(&private->io[i]);
+        }
+    }
+
+    for (int i = 0; i < private->total_io_queues; i++)
+    {
+        struct nvme_queue* queue = &private->io[i];
+        if (!queue->submitted)
+        {
+            continue;
+        }
+
+        int res = nvme_queue_wait(queue);
+        for (int command_id = 0; command_id < queue->submitted; command_id++)
+        {
+            if (res < 0 || queue->status[command_id] != 0)
+            {
+                commands[queue->owners[command_id]].status = -EIO;
+            }
+        }
+        queue->submitted = 0;
+    }
+}
+
+static int nvme_transfer(struct disk* disk, uint64_t lba, int total, void* buf, uint8_t opcode);
+
+// Note: splits every command into reads or writes (opcode) the controller can take and spreads them over the I/O queues
+static int nvme_transfer_batch(struct disk* disk, struct disk_command* commands, int total, uint8_t opcode)
+{
+    struct nvme_private* private = disk->driver_private;
+    int next_queue = 0;
+    int res = 0;
+
+    // Here: PRP entries must be dword aligned, commands that are not go the bounce buffer way before we queue anything
+    for (int i = 0; i < total; i++)
+    {
+        if (commands[i].status >= 0 && ((uint32_t) commands[i].buf & 3))
+        {
+            commands[i].status = nvme_transfer(disk, commands[i].lba, commands[i].total, commands[i].buf, opcode);
+        }
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        struct disk_command* command = &commands[i];
+        if (command->status < 0 || ((uint32_t) command->buf & 3))
+        {
+            continue;
+        }
+
+        uint64_t lba = command->lba;
+        int left = command->total;
+        void* buf = command->buf;
+        while (left > 0)
+        {
+            // Check: we fill the queues round robin, so when this one is full they all are
+            struct nvme_queue* queue = &private->io[next_queue];
+            if (queue->submitted == queue->entries - 1)
+            {
+                nvme_flush(private, commands);
+            }
+
+            int count = left > private->max_sectors ? private->max_sectors : left;
+            nvme_queue_io(private, queue, opcode, i, lba, count, buf);
+            next_queue = (next_queue + 1) % private->total_io_queues;
+
+            lba += count;
+            left -= count;
+            buf += count * disk->sector_size;
+        }
+    }
+
+    nvme_flush(private, commands);
+
+    for (int i = 0; i < total; i++)
+    {
+        if (commands[i].status < 0)
+        {
+            res = commands[i].status;
+        }
+    }
+
+    return res;
+}
+
+static int nvme_read_batch(struct disk* disk, struct disk_command* commands, int total)
+{
+    return nvme_transfer_batch(disk, commands, total, NVME_IO_READ);
+}
+
+// Note: a single read or write (opcode), through a bounce buffer when buf is not dword aligned
+static int nvme_transfer(struct disk* disk, uint64_t lba, int total, void* buf, uint8_t opcode)
+{
+    int res = 0;
+    void* bounce = 0;
+    if ((uint32_t) buf & 3)
+    {
+        bounce = kmalloc(total * disk->sector_size);
+        if (!bounce)
+        {
+            return -ENOMEM;
+        }
+
+        if (opcode == NVME_IO_WRITE)
+        {
+            memcpy(bounce, buf, total * disk->sector_size);
+        }
+    }
+
+    struct disk_command command;
+    command.lba = lba;
+    command.total = total;
+    command.buf = bounce ? bounce : buf;
+    command.status = 0;
+    res = nvme_transfer_batch(disk, &command, 1, opcode);
+
+    if (bounce)
+    {
+        if (res >= 0 && opcode == NVME_IO_READ)
+        {
+            memcpy(buf, bounce, total * disk->sector_size);
+        }
+        kfree(bounce);
+    }
+
+    return res;
+}
+
+static int nvme_read(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    return nvme_transfer(disk, lba, total, buf, NVME_IO_READ);
+}
+
+// Note: has the controller put its volatile write cache on the media, with one FLUSH on the first I/O queue
+static int nvme_flush_cache(struct nvme_private* private)
+{
+    struct nvme_queue* queue = &private->io[0];
+    struct nvme_command command;
+    memset(&command, 0, sizeof(command));
+    command.opcode = NVME_IO_FLUSH;
+    command.nsid = private->nsid;
+
+    int command_id = nvme_queue_submit(queue, &command);
+    nvme_queue_ring(queue);
+    int res = nvme_queue_wait(queue);
+    if (res == 0 && queue->status[command_id] != 0)
+    {
+        res = -EIO;
+    }
+    queue->submitted = 0;
+    return res;
+}
+
+static int nvme_write(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    return nvme_transfer(disk, lba, total, buf, NVME_IO_WRITE);
+}
+
+static int nvme_flush_disk(struct disk* disk)
+{
+    return nvme_flush_cache(disk->driver_private);
+}
+
+struct disk_driver nvme_driver =
+{
+    .read = nvme_read,
+    .read_batch = nvme_read_batch,
+    .write = nvme_write,
+    .flush = nvme_flush_disk,
+    .name = "NVMe"
+};
+
+// Note: resets the controller and brings it back up with our admin queues, interrupts stay masked as we poll
+static int nvme_enable(struct nvme_private* private)
+{
+    volatile struct nvme_registers* registers = private->registers;
+    registers->cc &= ~NVME_CC_EN;
+    if (nvme_wait_ready(registers, 0) < 0)
+    {
+        return -EIO;
+    }
+
+    registers->intms = 0xFFFFFFFF;
+
+    int res = nvme_queue_init(private, &private->admin, 0, NVME_ADMIN_QUEUE_ENTRIES);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    registers->aqa = ((NVME_ADMIN_QUEUE_ENTRIES - 1) << 16) | (NVME_ADMIN_QUEUE_ENTRIES - 1);
+    registers->asq = (uint32_t) private->admin.sq;
+    registers->asqu = 0;
+    registers->acq = (uint32_t) private->admin.cq;
+    registers->acqu = 0;
+
+    registers->cc = NVME_CC_IOSQES | NVME_CC_IOCQES | NVME_CC_EN;
+    return nvme_wait_ready(registers, 1);
+}
+
+// Note: creates I/O queue pair (id), the completion queue has to exist before the submission queue that uses it
+static int nvme_create_io_queue(struct nvme_private* private, struct nvme_queue* queue, uint16_t id, uint16_t entries)
+{
+    int res = nvme_queue_init(private, queue, id, entries);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    queue->prp_lists = kzalloc(NVME_PAGE_SIZE * (entries - 1));
+    if (!queue->prp_lists)
+    {
+        return -ENOMEM;
+    }
+
+    struct nvme_command command;
+    memset(&command, 0, sizeof(command));
+    command.opcode = NVME_ADMIN_CREATE_IO_CQ;
+    command.prp1 = (uint32_t) queue->cq;
+    command.cdw10 = ((entries - 1) << 16) | id;
+    command.cdw11 = NVME_QUEUE_PHYSICALLY_CONTIGUOUS;
+    res = nvme_admin_command(private, &command, 0);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    memset(&command, 0, sizeof(command));
+    command.opcode = NVME_ADMIN_CREATE_IO_SQ;
+    command.prp1 = (uint32_t) queue->sq;
+    command.cdw10 = ((entries - 1) << 16) | id;
+    command.cdw11 = (id << 16) | NVME_QUEUE_PHYSICALLY_CONTIGUOUS;
+    return nvme_admin_command(private, &command, 0);
+}
+
+// Note: identifies the controller and its first namespace, then sets up as many I/O queue pairs as it grants us
+static int nvme_attach(struct disk* disk, struct nvme_private* private)
+{
+    int res = 0;
+    uint8_t* identify = kzalloc(NVME_PAGE_SIZE);
+    if (!identify)
+    {
+        return -ENOMEM;
+    }
+
+    uint16_t max_entries = (private->registers->cap & 0xFFFF) + 1;
+    res = nvme_enable(private);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = nvme_identify(private, NVME_IDENTIFY_CONTROLLER, 0, identify);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // Note: MDTS (byte 77) limits a transfer to 2^MDTS pages, 0 means no limit
+    uint8_t mdts = identify[77];
+    uint32_t namespaces = *(uint32_t*)(identify + 516);
+    private->max_sectors = NVME_MAX_SECTORS_PER_COMMAND;
+    if (mdts && mdts < 9 && (NVME_PAGE_SIZE << mdts) / PEACHOS_SECTOR_SIZE < private->max_sectors)
+    {
+        private->max_sectors = (NVME_PAGE_SIZE << mdts) / PEACHOS_SECTOR_SIZE;
+    }
+
+    if (namespaces == 0)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    private->nsid = 1;
+    res = nvme_identify(private, NVME_IDENTIFY_NAMESPACE, private->nsid, identify);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // Check: the namespace must be formatted with sectors of our size, FLBAS picks the LBA format in use
+    uint8_t format = identify[26] & 0x0F;
+    uint8_t lba_shift = identify[128 + format * 4 + 2];
+    if (lba_shift >= 32 || (1 << lba_shift) != disk->sector_size)
+    {
+        res = -EIO;
+        goto out;
+    }
+    disk->total_sectors = *(uint64_t*) identify;
+
+    // Here: we ask for our queue pairs, the controller answers with how many it allocated (zero based)
+    struct nvme_command command;
+    uint32_t granted = 0;
+    memset(&command, 0, sizeof(command));
+    command.opcode = NVME_ADMIN_SET_FEATURES;
+    command.cdw10 = NVME_FEATURE_NUMBER_OF_QUEUES;
+    command.cdw11 = ((NVME_IO_QUEUE_PAIRS - 1) << 16) | (NVME_IO_QUEUE_PAIRS - 1);
+    res = nvme_admin_command(private, &command, &granted);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    int pairs = NVME_IO_QUEUE_PAIRS;
+    if ((granted & 0xFFFF) + 1 < pairs)
+        pairs = (granted & 0xFFFF) + 1;
+    if ((granted >> 16) + 1 < pairs)
+        pairs = (granted >> 16) + 1;
+
+    uint16_t entries = max_entries < NVME_IO_QUEUE_ENTRIES ? max_entries : NVME_IO_QUEUE_ENTRIES;
+    for (int i = 0; i < pairs; i++)
+    {
+        res = nvme_create_io_queue(private, &private->io[i], i + 1, entries);
+        if (res < 0)
+        {
+            nvme_queue_free(&private->io[i]);
+            break;
+        }
+        private->total_io_queues++;
+    }
+
+    // Check: one working queue pair is all we really need
+    if (private->total_io_queues == 0)
+    {
+        goto out;
+    }
+    res = 0;
+
+    disk->queue_depth = private->total_io_queues * (entries - 1);
+    if (disk->queue_depth > PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT)
+    {
+        disk->queue_depth = PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT;
+    }
+
+out:
+    kfree(identify);
+    return res;
+}
+
+// Note: looks for an NVMe controller and binds its first namespace to the disk
+int nvme_init(struct disk* disk)
+{
+    int res = 0;
+    struct pci_device device;
+    if (pci_find_class(NVME_PCI_CLASS, NVME_PCI_SUBCLASS, NVME_PCI_PROG_IF, 0, &device) < 0)
+    {
+        return -EIO;
+    }
+
+    pci_enable(&device, PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER);
+
+    // Note: BAR0 is a 64-bit memory BAR, we can only reach it when the upper half (BAR1) is zero
+    uint32_t bar = pci_get_bar(&device, 0);
+    if ((bar & 0x6) == 0x4 && pci_get_bar(&device, 1) != 0)
+    {
+        return -EIO;
+    }
+
+    struct nvme_private* private = kzalloc(sizeof(struct nvme_private));
+    if (!private)
+    {
+        return -ENOMEM;
+    }
+
+    private->registers = (volatile struct nvme_registers*)(bar & 0xFFFFFFF0);
+
+    // Note: CAP.DSTRD spaces the doorbells 4 << DSTRD bytes apart, CAP.MPSMIN must allow 4096 byte pages
+    private->doorbell_stride = 4 << (private->registers->capu & 0x0F);
+    if ((private->registers->capu >> 16) & 0x0F)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    res = nvme_attach(disk, private);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    disk->type = PEACHOS_DISK_TYPE_NVME;
+    disk->driver = &nvme_driver;
+    disk->driver_private = private;
+
+out:
+    if (res < 0)
+    {
+        private->registers->cc &= ~NVME_CC_EN;
+        nvme_queue_free(&private->admin);
+        for (int i = 0; i < private->total_io_queues; i++)
+        {
+            nvme_queue_free(&private->io[i]);
+        }
+        kfree(private);
+    }
+    return res;
+}
@@ -0,0 +1,70 @@
+#ifndef NVME_H
+#define NVME_H
+
+#include <stdint.h>
+
+// PCI class of an NVM Express controller
+#define NVME_PCI_CLASS 0x01
+#define NVME_PCI_SUBCLASS 0x08
+#define NVME_PCI_PROG_IF 0x02
+
+// Entries of the admin queues and of every I/O queue we create
+#define NVME_ADMIN_QUEUE_ENTRIES 16
+#define NVME_IO_QUEUE_ENTRIES 32
+// I/O submission/completion queue pairs we ask the controller for
+#define NVME_IO_QUEUE_PAIRS 2
+
+// The controller registers at the start of BAR0 (NVMe 1.4, section 3.1)
+struct nvme_registers
+{
+    uint32_t cap;       // Controller capabilities
+    uint32_t capu;
+    uint32_t vs;        // Version
+    uint32_t intms;     // Interrupt mask set
+    uint32_t intmc;     // Interrupt mask clear
+    uint32_t cc;        // Controller configuration
+    uint32_t reserved;
+    uint32_t csts;      // Controller status
+    uint32_t nssr;
+    uint32_t aqa;       // Admin queue attributes
+    uint32_t asq;       // Admin submission queue base address, page aligned
+    uint32_t asqu;
+    uint32_t acq;       // Admin completion queue base address, page aligned
+    uint32_t acqu;
+} __attribute__((packed));
+
+// Submission queue entry, the same layout serves admin and I/O commands
+struct nvme_command
+{
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t command_id;
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t metadata;
+    uint64_t prp1;      // First data page, may start at an offset
+    uint64_t prp2;      // Second data page or the address of a PRP list
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} __attribute__((packed));
+
+// Completion queue entry
+struct nvme_completion
+{
+    uint32_t result;
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t command_id;
+    uint16_t status;    // Bit 0: phase tag, bits 1-15: status field
+} __attribute__((packed));
+
+struct disk;
+
+int nvme_init(struct disk* disk);
+
+#endif
@@ -0,0 +1,157 @@
+#include "partition.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// Private data of a partition, it is a window of (total_sectors) sectors into its parent disk
+struct partition_private
+{
+    struct disk* parent;
+    uint64_t lba_offset;
+};
+
+// Note: commands are shifted into the parent disk and handed to its driver as one batch
+static int partition_read_batch(struct disk* idisk, struct disk_command* commands, int total)
+{
+    struct partition_private* private = idisk->driver_private;
+    for (int i = 0; i < total; i++)
+    {
+        // Check: a partition never reads past its own end
+        if (commands[i].lba + commands[i].total > idisk->total_sectors)
+        {
+            commands[i].status = -EIO;
+        }
+        commands[i].lba += private->lba_offset;
+    }
+
+    int res = disk_driver_read_batch(private->parent, commands, total);
+    for (int i = 0; i < total; i++)
+    {
+        commands[i].lba -= private->lba_offset;
+    }
+
+    return res;
+}
+
+static int partition_read(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    struct disk_command command;
+    command.lba = lba;
+    command.total = total;
+    command.buf = buf;
+    command.status = 0;
+    return partition_read_batch(idisk, &command, 1);
+}
+
+// Note: disk_write_block kept the write inside the partition, we only shift it into the parent disk
+static int partition_write(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    struct partition_private* private = idisk->driver_private;
+    return disk_driver_write(private->parent, lba + private->lba_offset, total, buf);
+}
+
+static int partition_flush(struct disk* idisk)
+{
+    struct partition_private* private = idisk->driver_private;
+    return disk_driver_flush(private->parent);
+}
+
+struct disk_driver partition_driver =
+{
+    .read = partition_read,
+    .read_batch = partition_read_batch,
+    .write = partition_write,
+    .flush = partition_flush,
+    .name = "Partition"
+};
+
+static struct disk* partition_new(struct disk* parent, struct mbr_partition_entry* entry)
+{
+    struct disk* idisk = disk_new();
+    struct partition_private* private = kzalloc(sizeof(struct partition_private));
+    if (!idisk || !private)
+    {
+        if (idisk)
+            kfree(idisk);
+        if (private)
+            kfree(private);
+        return 0;
+    }
+
+    private->parent = parent;
+    private->lba_offset = entry->lba_first;
+
+    idisk->type = PEACHOS_DISK_TYPE_PARTITION;
+    idisk->sector_size = parent->sector_size;
+    idisk->total_sectors = entry->total_sectors;
+    idisk->driver = &partition_driver;
+    idisk->driver_private = private;
+    idisk->queue_depth = parent->queue_depth;
+    idisk->read_only = disk_is_read_only(parent);
+    return idisk;
+}
+
+// Note: reads the MBR of the disk and registers every primary partition as a disk of its own, with its own filesystem
+// Note: extended partitions (and the logical ones inside them) are skipped
+int partition_scan_mbr(struct disk* idisk)
+{
+    int res = 0;
+    int found = 0;
+    struct mbr* mbr = kzalloc(sizeof(struct mbr));
+    if (!mbr)
+    {
+        return -ENOMEM;
+    }
+
+    res = disk_read_block(idisk, 0, 1, mbr);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (mbr->signature != MBR_SIGNATURE)
+    {
+        res = -EINFORMAT;
+        goto out;
+    }
+
+    for (int i = 0; i < MBR_TOTAL_PARTITIONS; i++)
+    {
+        struct mbr_partition_entry* entry = &mbr->partitions[i];
+        if (entry->type == MBR_TYPE_EMPTY || entry->type == MBR_TYPE_EXTENDED_CHS || entry->type == MBR_TYPE_EXTENDED_LBA || entry->type == MBR_TYPE_EXTENDED_LINUX || entry->total_sectors == 0)
+        {
+            continue;
+        }
+
+        // Check: the entry must fit the disk, when we know how big the disk is
+        if (idisk->total_sectors && (uint64_t) entry->lba_first + entry->total_sectors > idisk->total_sectors)
+        {
+            continue;
+        }
+
+        struct disk* partition = partition_new(idisk, entry);
+        if (!partition)
+        {
+            res = -ENOMEM;
+            goto out;
+        }
+
+        if (disk_register(partition) < 0)
+        {
+            kfree(partition->driver_private);
+            kfree(partition);
+            break;
+        }
+
+        partition->filesystem = fs_resolve(partition);
+        found++;
+    }
+
+    res = found;
+
+out:
+    kfree(mbr);
+    return res;
+}
@@ -0,0 +1,37 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdint.h>
+
+#define MBR_SIGNATURE 0xAA55
+#define MBR_TOTAL_PARTITIONS 4
+
+// Partition types we do not treat as volumes of their own
+#define MBR_TYPE_EMPTY 0x00
+#define MBR_TYPE_EXTENDED_CHS 0x05
+#define MBR_TYPE_EXTENDED_LBA 0x0F
+#define MBR_TYPE_EXTENDED_LINUX 0x85
+
+struct mbr_partition_entry
+{
+    uint8_t status;
+    uint8_t chs_first[3];
+    uint8_t type;
+    uint8_t chs_last[3];
+    uint32_t lba_first;
+    uint32_t total_sectors;
+} __attribute__((packed));
+
+// Sector 0 of a partitioned disk
+struct mbr
+{
+    uint8_t bootstrap[446];
+    struct mbr_partition_entry partitions[MBR_TOTAL_PARTITIONS];
+    uint16_t signature;
+} __attribute__((packed));
+
+struct disk;
+
+int partition_scan_mbr(struct disk* disk);
+
+#endif
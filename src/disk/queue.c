@@ -0,0 +1,251 @@
+#include "queue.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "cpu/cpu.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+static uint64_t diskqueue_request_end(struct disk_request* request)
+{
+    return request->lba + request->total;
+}
+
+void diskqueue_init(struct disk_queue* queue)
+{
+    memset(queue, 0, sizeof(struct disk_queue));
+}
+
+// Note: queues the request in lba order and returns straight away, the result arrives through on_complete/diskqueue_wait
+int diskqueue_submit(struct disk* disk, struct disk_request* request)
+{
+    struct disk_queue* queue = &disk->queue;
+    if (request->total <= 0 || !request->buf)
+    {
+        return -EINVARG;
+    }
+
+    request->status = 0;
+    request->complete = false;
+    request->submit_time = cpu_read_tsc();
+
+    // Here: we insert it after every request with a lower or equal lba
+    struct disk_request** link = &queue->head;
+    while (*link && (*link)->lba <= request->lba)
+    {
+        link = &(*link)->next;
+    }
+    request->next = *link;
+    *link = request;
+
+    queue->depth++;
+    queue->stats.submitted++;
+    if (queue->depth > queue->stats.max_depth)
+    {
+        queue->stats.max_depth = queue->depth;
+    }
+
+    // Check: the queue is full, so we drain it now rather than growing forever
+    if (queue->depth >= PEACHOS_DISK_QUEUE_MAX_DEPTH)
+    {
+        return diskqueue_run(disk);
+    }
+
+    return 0;
+}
+
+// Note: requests of a run are sorted by lba, if each one continues exactly where the last one ended on disk and in memory we need no bounce buffer
+static bool diskqueue_run_is_linear(struct disk* disk, struct disk_request* first, struct disk_request* last)
+{
+    struct disk_request* request = first;
+    while (request != last)
+    {
+        struct disk_request* next = request->next;
+        if (next->lba != diskqueue_request_end(request) || next->buf != request->buf + request->total * disk->sector_size)
+        {
+            return false;
+        }
+        request = next;
+    }
+
+    return true;
+}
+
+static void diskqueue_complete(struct disk_queue* queue, struct disk_request* request, int status)
+{
+    uint64_t latency = cpu_read_tsc() - request->submit_time;
+    queue->stats.completed++;
+    queue->stats.total_latency += latency;
+    if (latency > queue->stats.max_latency)
+    {
+        queue->stats.max_latency = latency;
+    }
+
+    request->status = status;
+    request->complete = true;
+    if (request->on_complete)
+    {
+        request->on_complete(request);
+    }
+}
+
+// A group of requests (first..last) served by one command
+struct diskqueue_merged
+{
+    struct disk_request* first;
+    struct disk_request* last;
+    void* bounce;
+};
+
+// Note: takes the next run of the C-LOOK sweep off the queue and fills in the command that serves it
+static void diskqueue_take_run(struct disk* disk, struct diskqueue_merged* merged, struct disk_command* command)
+{
+    struct disk_queue* queue = &disk->queue;
+
+    // Here: we find the first request at or above the elevator position (or wrap around)
+    struct disk_request* prev = 0;
+    struct disk_request* first = queue->head;
+    while (first && first->lba < queue->position)
+    {
+        prev = first;
+        first = first->next;
+    }
+
+    if (!first)
+    {
+        prev = 0;
+        first = queue->head;
+    }
+
+    // Here: we grow the run while the next request touches it and it still fits one merged command
+    struct disk_request* last = first;
+    uint64_t end = diskqueue_request_end(first);
+    while (last->next && last->next->lba <= end)
+    {
+        uint64_t next_end = diskqueue_request_end(last->next);
+        uint64_t new_end = next_end > end ? next_end : end;
+        if (new_end - first->lba > PEACHOS_DISK_QUEUE_MAX_MERGE_SECTORS)
+        {
+            break;
+        }
+
+        end = new_end;
+        last = last->next;
+    }
+
+    // Here: we unlink the run from the queue
+    if (prev)
+    {
+        prev->next = last->next;
+    }
+    else
+    {
+        queue->head = last->next;
+    }
+    last->next = 0;
+    queue->position = end;
+
+    merged->first = first;
+    merged->last = last;
+    merged->bounce = 0;
+
+    command->lba = first->lba;
+    command->total = end - first->lba;
+    command->buf = first->buf;
+    command->status = 0;
+
+    if (!diskqueue_run_is_linear(disk, first, last))
+    {
+        // Here: the requests overlap or want their data in unrelated places, so we read once and hand out copies
+        merged->bounce = kmalloc(command->total * disk->sector_size);
+        command->buf = merged->bounce;
+        if (!merged->bounce)
+        {
+            command->status = -ENOMEM;
+        }
+    }
+}
+
+// Note: completes every request of a run with the status of its command
+static void diskqueue_complete_run(struct disk* disk, struct diskqueue_merged* merged, int res)
+{
+    struct disk_queue* queue = &disk->queue;
+    struct disk_request* request = merged->first;
+
+    // Here: we detach the requests before completing them, so callbacks are free to submit again
+    while (request)
+    {
+        struct disk_request* next = request->next;
+        request->next = 0;
+        queue->depth--;
+        if (request != merged->first)
+        {
+            queue->stats.merged++;
+        }
+
+        if (merged->bounce && res >= 0)
+        {
+            memcpy(request->buf, merged->bounce + (request->lba - merged->first->lba) * disk->sector_size, request->total * disk->sector_size);
+        }
+
+        diskqueue_complete(queue, request, res);
+        request = next;
+    }
+
+    if (merged->bounce)
+    {
+        kfree(merged->bounce);
+    }
+}
+
+// Note: drains the queue with a C-LOOK elevator, sweeping upwards from the current position then wrapping to the lowest lba
+// Note: adjacent or overlapping requests are merged into a single command, and up to queue_depth commands are handed to the driver at once
+int diskqueue_run(struct disk* disk)
+{
+    struct disk_queue* queue = &disk->queue;
+    struct diskqueue_merged merged[PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT];
+    struct disk_command commands[PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT];
+    int max_batch = disk->queue_depth;
+    int res = 0;
+
+    if (max_batch < 1 || max_batch > PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT)
+    {
+        max_batch = max_batch < 1 ? 1 : PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT;
+    }
+
+    while (queue->head)
+    {
+        int total = 0;
+        while (queue->head && total < max_batch)
+        {
+            diskqueue_take_run(disk, &merged[total], &commands[total]);
+            total++;
+        }
+
+        disk_driver_read_batch(disk, commands, total);
+        queue->stats.dispatched += total;
+
+        // Note: requests are completed only after the whole batch is back, completions may submit new work
+        for (int i = 0; i < total; i++)
+        {
+            diskqueue_complete_run(disk, &merged[i], commands[i].status);
+            if (commands[i].status < 0)
+            {
+                res = commands[i].status;
+            }
+        }
+    }
+
+    return res;
+}
+
+// Note: blocks until the request completed (dispatching the queue if needed) and returns its status
+int diskqueue_wait(struct disk* disk, struct disk_request* request)
+{
+    if (!request->complete)
+    {
+        diskqueue_run(disk);
+    }
+
+    return request->status;
+}
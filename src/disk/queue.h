@@ -0,0 +1,67 @@
+#ifndef DISKQUEUE_H
+#define DISKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct disk;
+struct disk_request;
+
+typedef void (*DISK_REQUEST_COMPLETE_FUNCTION)(struct disk_request* request);
+
+// A single read of (total) sectors starting at (lba) into (buf)
+struct disk_request
+{
+    uint64_t lba;
+    int total;
+    void* buf;
+
+    // Result of the request, only valid once complete is set
+    int status;
+    bool complete;
+
+    // Optional: called once the request completed, may be used to chain more requests
+    DISK_REQUEST_COMPLETE_FUNCTION on_complete;
+    // Free for the submitter to use
+    void* private;
+
+    // TSC value at submit time, used for latency accounting
+    uint64_t submit_time;
+
+    // Next request in the queue (sorted by lba)
+    struct disk_request* next;
+};
+
+struct disk_queue_stats
+{
+    uint32_t submitted;
+    uint32_t completed;
+    // Requests that rode along on another requests command
+    uint32_t merged;
+    // Commands issued to the driver
+    uint32_t dispatched;
+    uint32_t max_depth;
+
+    // Submit to complete latency in TSC cycles
+    uint64_t total_latency;
+    uint64_t max_latency;
+};
+
+struct disk_queue
+{
+    // Pending requests sorted by lba
+    struct disk_request* head;
+    int depth;
+
+    // Where the elevator currently is (the sector after the last dispatched command)
+    uint64_t position;
+
+    struct disk_queue_stats stats;
+};
+
+void diskqueue_init(struct disk_queue* queue);
+int diskqueue_submit(struct disk* disk, struct disk_request* request);
+int diskqueue_run(struct disk* disk);
+int diskqueue_wait(struct disk* disk, struct disk_request* request);
+
+#endif
@@ -0,0 +1,139 @@
+#include "ramdisk.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// Private data of a RAM disk: the first (loaded_sectors) sectors of the source disk, copied into memory at boot
+struct ramdisk_private
+{
+    void* memory;
+    uint64_t loaded_sectors;
+
+    // Sectors past the loaded region are still read from here
+    struct disk* source;
+};
+
+// Note: reads are a memcpy out of the region, anything past it falls through to the source disk
+static int ramdisk_read(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    struct ramdisk_private* private = idisk->driver_private;
+    if (idisk->total_sectors && lba + total > idisk->total_sectors)
+    {
+        return -EIO;
+    }
+
+    if (lba < private->loaded_sectors)
+    {
+        int count = total;
+        if (lba + count > private->loaded_sectors)
+        {
+            count = private->loaded_sectors - lba;
+        }
+
+        memcpy(buf, private->memory + lba * idisk->sector_size, count * idisk->sector_size);
+        lba += count;
+        total -= count;
+        buf += count * idisk->sector_size;
+    }
+
+    if (total > 0)
+    {
+        return disk_read_block(private->source, lba, total, buf);
+    }
+
+    return 0;
+}
+
+// Note: writes go through to the source disk first and land in the region only once they made it there, so the copy
+// never holds data the disk does not
+static int ramdisk_write(struct disk* idisk, uint64_t lba, int total, void* buf)
+{
+    struct ramdisk_private* private = idisk->driver_private;
+    int res = disk_driver_write(private->source, lba, total, buf);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (lba < private->loaded_sectors)
+    {
+        int count = total;
+        if (lba + count > private->loaded_sectors)
+        {
+            count = private->loaded_sectors - lba;
+        }
+
+        memcpy(private->memory + lba * idisk->sector_size, buf, count * idisk->sector_size);
+    }
+
+    return 0;
+}
+
+// Note: the region always matches the source disk, only the source has something to flush
+static int ramdisk_flush(struct disk* idisk)
+{
+    struct ramdisk_private* private = idisk->driver_private;
+    return disk_driver_flush(private->source);
+}
+
+struct disk_driver ramdisk_driver =
+{
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .flush = ramdisk_flush,
+    .name = "RAM disk"
+};
+
+// Note: the initial loader: copies the start of (source) into memory with a single read and returns a disk serving it
+struct disk* ramdisk_load(struct disk* source)
+{
+    // Check: without a size we do not know how much to load
+    if (!source->total_sectors || source->sector_size != PEACHOS_SECTOR_SIZE)
+    {
+        return 0;
+    }
+
+    struct disk* idisk = disk_new();
+    struct ramdisk_private* private = kzalloc(sizeof(struct ramdisk_private));
+    if (!idisk || !private)
+    {
+        goto fail;
+    }
+
+    private->source = source;
+    private->loaded_sectors = source->total_sectors;
+    if (private->loaded_sectors > PEACHOS_RAMDISK_MAX_BYTES / PEACHOS_SECTOR_SIZE)
+    {
+        private->loaded_sectors = PEACHOS_RAMDISK_MAX_BYTES / PEACHOS_SECTOR_SIZE;
+    }
+
+    private->memory = kmalloc(private->loaded_sectors * PEACHOS_SECTOR_SIZE);
+    if (!private->memory)
+    {
+        goto fail;
+    }
+
+    if (disk_read_block(source, 0, private->loaded_sectors, private->memory) < 0)
+    {
+        goto fail;
+    }
+
+    idisk->type = PEACHOS_DISK_TYPE_RAM;
+    idisk->total_sectors = source->total_sectors;
+    idisk->driver = &ramdisk_driver;
+    idisk->driver_private = private;
+    idisk->queue_depth = 1;
+    idisk->read_only = disk_is_read_only(source);
+    return idisk;
+
+fail:
+    if (private && private->memory)
+        kfree(private->memory);
+    if (private)
+        kfree(private);
+    if (idisk)
+        kfree(idisk);
+    return 0;
+}
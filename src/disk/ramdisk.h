@@ -0,0 +1,8 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+struct disk;
+
+struct disk* ramdisk_load(struct disk* source);
+
+#endif
@@ -2,6 +2,7 @@
 #include "streamer.h"
 #include "memory/heap/kheap.h"
 #include "config.h"
+#include "memory/memory.h"
 
 
 struct disk_stream* diskstreamer_new(int disk_id)
@@ -18,45 +19,59 @@ struct disk_stream* diskstreamer_new(int disk_id)
     return streamer;
 }
 
-int diskstreamer_seek(struct disk_stream* stream, int pos)
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos)
 {
     stream->pos = pos;
     return 0;
 }
 
-// Note: we read a sector from disk
+// Note: we read a partial sector through buf[], and every whole sector in between straight into out
 // Note: void* out has no boundm but buf[] has
 int diskstreamer_read(struct disk_stream* stream, void* out, int total)
 {
-    int sector = stream->pos / PEACHOS_SECTOR_SIZE;
-    int offset = stream->pos % PEACHOS_SECTOR_SIZE;
-
-    int total_to_read = total;
-    bool overflow = (offset+total_to_read) >= PEACHOS_SECTOR_SIZE;
-    
+    int res = 0;
     char buf[PEACHOS_SECTOR_SIZE];
 
-    if (overflow) {
-        total_to_read -= (offset+total_to_read) - PEACHOS_SECTOR_SIZE;
-    }
-    
-    int res = disk_read_block(stream->disk, sector, 1, buf);
-    if (res < 0)
+    while (total > 0)
     {
-        goto out;
-    }
+        uint64_t sector = stream->pos / PEACHOS_SECTOR_SIZE;
+        int offset = stream->pos % PEACHOS_SECTOR_SIZE;
+        int total_to_read = 0;
 
-    for (int i = 0; i < total_to_read; i++)
-    {
-        *(char*)out++ = buf[offset+i];
-    }
+        if (offset == 0 && total >= PEACHOS_SECTOR_SIZE)
+        {
+            // Here: one big request for all whole sectors, the driver splits it into commands
+            int sectors = total / PEACHOS_SECTOR_SIZE;
+            total_to_read = sectors * PEACHOS_SECTOR_SIZE;
+            res = disk_read_block(stream->disk, sector, sectors, out);
+            if (res < 0)
+            {
+                goto out;
+            }
+        }
+        else
+        {
+            total_to_read = PEACHOS_SECTOR_SIZE - offset;
+            if (total_to_read > total)
+            {
+                total_to_read = total;
+            }
 
-    // Adjust the stream
-    stream->pos += total_to_read;
-    if (overflow)
-    {
-        res = diskstreamer_read(stream, out, total-total_to_read);
+            res = disk_read_block(stream->disk, sector, 1, buf);
+            if (res < 0)
+            {
+                goto out;
+            }
+
+            memcpy(out, buf + offset, total_to_read);
+        }
+
+        // Adjust the stream
+        out += total_to_read;
+        stream->pos += total_to_read;
+        total -= total_to_read;
     }
+
 out:
     return res;
 }
@@ -1,17 +1,19 @@
 #ifndef DISKSTREAMER_H
 #define DISKSTREAMER_H
 
+#include <stdint.h>
 #include "disk.h"
 
 struct disk_stream
 {
-    int pos;
+    // Byte position on the disk, 64-bit so we can stream past 2 GiB
+    uint64_t pos;
     struct disk* disk;
 };
 
 struct disk_stream* diskstreamer_new(int disk_id);
-int diskstreamer_seek(struct disk_stream* stream, int pos);
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos);
 int diskstreamer_read(struct disk_stream* stream, void* out, int total);
 void diskstreamer_close(struct disk_stream* stream);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,308 @@
+#include "virtio_blk.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "io/io.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// Every request is a chain of three descriptors: header, data, status
+#define VIRTIO_BLK_DESCRIPTORS_PER_REQUEST 3
+// Biggest data descriptor we hand the device
+#define VIRTIO_BLK_MAX_SECTORS_PER_REQUEST 8192
+
+// How long we spin on the used ring before giving up
+#define VIRTIO_BLK_SPIN_TIMEOUT 100000000
+
+// Per request memory the device reads the header from and writes the status to
+struct virtio_blk_slot
+{
+    struct virtio_blk_request_header header;
+    uint8_t status;
+};
+
+// Private data of a virtio block disk
+struct virtio_blk_private
+{
+    uint16_t io_base;
+
+    // The request virtqueue (queue 0)
+    uint16_t queue_size;
+    volatile struct virtq_desc* desc;
+    volatile struct virtq_avail* avail;
+    volatile struct virtq_used* used;
+    // Used ring entries we have already consumed
+    uint16_t last_used_idx;
+
+    // Requests we can have in flight, each one owns descriptors 3*i..3*i+2
+    int total_slots;
+    volatile struct virtio_blk_slot* slots;
+    // Index of the batch command each slot belongs to
+    int owners[PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT];
+};
+
+static uint32_t virtio_blk_align(uint32_t value)
+{
+    return (value + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+}
+
+// Note: size of a legacy virtqueue: descriptors and avail ring, then the used ring on its own page
+static uint32_t virtio_blk_queue_bytes(uint16_t queue_size)
+{
+    uint32_t desc_avail = sizeof(struct virtq_desc) * queue_size + sizeof(uint16_t) * (3 + queue_size);
+    uint32_t used = sizeof(uint16_t) * 3 + sizeof(struct virtq_used_elem) * queue_size;
+    return virtio_blk_align(desc_avail) + virtio_blk_align(used);
+}
+
+// Note: writes the descriptor chain of one request of (type) into its slot and puts it on the avail ring (not yet visible to the device)
+static void virtio_blk_queue_request(struct virtio_blk_private* private, int slot, uint16_t avail_offset, uint32_t type, uint64_t lba, int total, void* buf, int sector_size)
+{
+    volatile struct virtio_blk_slot* request = &private->slots[slot];
+    int head = slot * VIRTIO_BLK_DESCRIPTORS_PER_REQUEST;
+
+    request->header.type = type;
+    request->header.reserved = 0;
+    request->header.sector = lba;
+    request->status = 0xFF;
+
+    private->desc[head].addr = (uint32_t) &request->header;
+    private->desc[head].len = sizeof(struct virtio_blk_request_header);
+    private->desc[head].flags = VIRTQ_DESC_F_NEXT;
+    private->desc[head].next = head + 1;
+
+    // Note: on a read the device writes into our buffer, hence the WRITE flag
+    private->desc[head + 1].addr = (uint32_t) buf;
+    private->desc[head + 1].len = total * sector_size;
+    private->desc[head + 1].flags = type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE : VIRTQ_DESC_F_NEXT;
+    private->desc[head + 1].next = head + 2;
+
+    private->desc[head + 2].addr = (uint32_t) &request->status;
+    private->desc[head + 2].len = sizeof(uint8_t);
+    private->desc[head + 2].flags = VIRTQ_DESC_F_WRITE;
+    private->desc[head + 2].next = 0;
+
+    private->avail->ring[(uint16_t)(private->avail->idx + avail_offset) % private->queue_size] = head;
+}
+
+// Note: publishes (total) queued requests with one index update and at most one notify, then polls until they are all used
+static int virtio_blk_kick_and_wait(struct virtio_blk_private* private, int total, struct disk_command* commands)
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    private->avail->idx += total;
+    // Check: the device may tell us it is already processing the ring and needs no notify
+    if (!(private->used->flags & VIRTQ_USED_F_NO_NOTIFY))
+    {
+        outw(private->io_base + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+    }
+
+    uint16_t target = private->last_used_idx + total;
+    int spin = 0;
+    while (private->used->idx != target)
+    {
+        if (++spin >= VIRTIO_BLK_SPIN_TIMEOUT)
+        {
+            // Check: we can not tell which ones made it, so the whole batch failed
+            for (int i = 0; i < total; i++)
+            {
+                commands[private->owners[i]].status = -EIO;
+            }
+            return -EIO;
+        }
+    }
+
+    // Here: we read the results of every request that came back
+    int res = 0;
+    while (private->last_used_idx != target)
+    {
+        volatile struct virtq_used_elem* elem = &private->used->ring[private->last_used_idx % private->queue_size];
+        int slot = elem->id / VIRTIO_BLK_DESCRIPTORS_PER_REQUEST;
+        if (private->slots[slot].status != VIRTIO_BLK_S_OK)
+        {
+            commands[private->owners[slot]].status = -EIO;
+            res = -EIO;
+        }
+        private->last_used_idx++;
+    }
+
+    return res;
+}
+
+// Note: splits every command into requests of (type) and submits as many as we have slots for in one go
+static int virtio_blk_submit_batch(struct disk* disk, struct disk_command* commands, int total, uint32_t type)
+{
+    struct virtio_blk_private* private = disk->driver_private;
+    int queued = 0;
+    int res = 0;
+
+    for (int i = 0; i < total; i++)
+    {
+        struct disk_command* command = &commands[i];
+        if (command->status < 0)
+        {
+            continue;
+        }
+
+        uint64_t lba = command->lba;
+        int left = command->total;
+        void* buf = command->buf;
+        while (left > 0)
+        {
+            // Check: all slots are in use, so this batch goes out before we continue
+            if (queued == private->total_slots)
+            {
+                virtio_blk_kick_and_wait(private, queued, commands);
+                queued = 0;
+            }
+
+            int count = left > VIRTIO_BLK_MAX_SECTORS_PER_REQUEST ? VIRTIO_BLK_MAX_SECTORS_PER_REQUEST : left;
+            virtio_blk_queue_request(private, queued, queued, type, lba, count, buf, disk->sector_size);
+            private->owners[queued] = i;
+            queued++;
+
+            lba += count;
+            left -= count;
+            buf += count * disk->sector_size;
+        }
+    }
+
+    virtio_blk_kick_and_wait(private, queued, commands);
+
+    for (int i = 0; i < total; i++)
+    {
+        if (commands[i].status < 0)
+        {
+            res = commands[i].status;
+        }
+    }
+
+    return res;
+}
+
+static int virtio_blk_read_batch(struct disk* disk, struct disk_command* commands, int total)
+{
+    return virtio_blk_submit_batch(disk, commands, total, VIRTIO_BLK_T_IN);
+}
+
+static int virtio_blk_read(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    struct disk_command command;
+    command.lba = lba;
+    command.total = total;
+    command.buf = buf;
+    command.status = 0;
+    return virtio_blk_read_batch(disk, &command, 1);
+}
+
+// Note: the request is used once the device has the data, we do not negotiate a write cache so that is on the disk
+static int virtio_blk_write(struct disk* disk, uint64_t lba, int total, void* buf)
+{
+    struct disk_command command;
+    command.lba = lba;
+    command.total = total;
+    command.buf = buf;
+    command.status = 0;
+    return virtio_blk_submit_batch(disk, &command, 1, VIRTIO_BLK_T_OUT);
+}
+
+struct disk_driver virtio_blk_driver =
+{
+    .read = virtio_blk_read,
+    .read_batch = virtio_blk_read_batch,
+    .write = virtio_blk_write,
+    .name = "virtio-blk"
+};
+
+// Note: sets up the request virtqueue (queue 0) and tells the device where it lives
+static int virtio_blk_setup_queue(struct virtio_blk_private* private)
+{
+    outw(private->io_base + VIRTIO_PCI_QUEUE_SELECT, 0);
+    private->queue_size = insw(private->io_base + VIRTIO_PCI_QUEUE_SIZE);
+    if (private->queue_size == 0)
+    {
+        return -EIO;
+    }
+
+    // Note: kzalloc hands out 4096 byte aligned memory, exactly what a legacy queue needs
+    void* queue = kzalloc(virtio_blk_queue_bytes(private->queue_size));
+    if (!queue)
+    {
+        return -ENOMEM;
+    }
+
+    private->desc = queue;
+    private->avail = queue + sizeof(struct virtq_desc) * private->queue_size;
+    private->used = queue + virtio_blk_align(sizeof(struct virtq_desc) * private->queue_size + sizeof(uint16_t) * (3 + private->queue_size));
+    private->last_used_idx = 0;
+
+    // Here: we poll, so interrupts are suppressed for the whole life of the queue
+    private->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+
+    private->total_slots = private->queue_size / VIRTIO_BLK_DESCRIPTORS_PER_REQUEST;
+    if (private->total_slots > PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT)
+    {
+        private->total_slots = PEACHOS_DISK_MAX_COMMANDS_IN_FLIGHT;
+    }
+
+    private->slots = kzalloc(sizeof(struct virtio_blk_slot) * private->total_slots);
+    if (!private->slots)
+    {
+        kfree(queue);
+        return -ENOMEM;
+    }
+
+    outl(private->io_base + VIRTIO_PCI_QUEUE_PFN, (uint32_t) queue / VIRTQ_ALIGN);
+    return 0;
+}
+
+// Note: looks for a virtio block device and binds it to the disk
+int virtio_blk_init(struct disk* disk)
+{
+    struct pci_device device;
+    if (pci_find_device(VIRTIO_PCI_VENDOR_ID, VIRTIO_BLK_PCI_DEVICE_ID, 0, &device) < 0)
+    {
+        return -EIO;
+    }
+
+    pci_enable(&device, PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER);
+
+    struct virtio_blk_private* private = kzalloc(sizeof(struct virtio_blk_private));
+    if (!private)
+    {
+        return -ENOMEM;
+    }
+
+    // Note: BAR0 is an I/O BAR, bit 0 says so and is not part of the address
+    private->io_base = pci_get_bar(&device, 0) & 0xFFFC;
+
+    // Here: reset, then tell the device we found it and know how to drive it
+    outb(private->io_base + VIRTIO_PCI_DEVICE_STATUS, 0);
+    outb(private->io_base + VIRTIO_PCI_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(private->io_base + VIRTIO_PCI_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    // Note: we need none of the optional features, plain 512 byte sector reads and writes are all we do. Without a
+    // negotiated flush the device writes through, and it tells us when it takes no writes at all
+    uint32_t features = insl(private->io_base + VIRTIO_PCI_DEVICE_FEATURES);
+    outl(private->io_base + VIRTIO_PCI_GUEST_FEATURES, 0);
+
+    if (virtio_blk_setup_queue(private) < 0)
+    {
+        outb(private->io_base + VIRTIO_PCI_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        kfree(private);
+        return -EIO;
+    }
+
+    outb(private->io_base + VIRTIO_PCI_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    disk->total_sectors = (uint64_t) insl(private->io_base + VIRTIO_BLK_CONFIG_CAPACITY) | ((uint64_t) insl(private->io_base + VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32);
+    disk->type = PEACHOS_DISK_TYPE_VIRTIO;
+    disk->driver = &virtio_blk_driver;
+    disk->driver_private = private;
+    disk->queue_depth = private->total_slots;
+    disk->read_only = (features & VIRTIO_BLK_F_RO) != 0;
+    return 0;
+}
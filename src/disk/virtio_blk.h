@@ -0,0 +1,85 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+// Transitional virtio block device, the legacy (0.9.5) I/O port interface is what we speak
+#define VIRTIO_PCI_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_PCI_DEVICE_ID 0x1001
+
+// Legacy PCI register offsets in the BAR0 I/O space
+#define VIRTIO_PCI_DEVICE_FEATURES 0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN 0x08
+#define VIRTIO_PCI_QUEUE_SIZE 0x0C
+#define VIRTIO_PCI_QUEUE_SELECT 0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10
+#define VIRTIO_PCI_DEVICE_STATUS 0x12
+#define VIRTIO_PCI_ISR_STATUS 0x13
+// Block device configuration: 64-bit capacity in 512 byte sectors
+#define VIRTIO_BLK_CONFIG_CAPACITY 0x14
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTQ_DESC_F_NEXT 0x01
+#define VIRTQ_DESC_F_WRITE 0x02
+// We poll the used ring, so the device should not interrupt us
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x01
+// The device does not need a notify for new buffers right now
+#define VIRTQ_USED_F_NO_NOTIFY 0x01
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_S_OK 0
+
+// Device feature bit: the disk only takes reads
+#define VIRTIO_BLK_F_RO (1 << 5)
+
+// Legacy virtqueues are laid out in 4096 byte pages
+#define VIRTQ_ALIGN 4096
+
+struct virtq_desc
+{
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail
+{
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem
+{
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used
+{
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+// Leading part of every block request, the device reads it
+struct virtio_blk_request_header
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed));
+
+struct disk;
+
+int virtio_blk_init(struct disk* disk);
+
+#endif
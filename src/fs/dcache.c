@@ -0,0 +1,214 @@
+#include "dcache.h"
+#include "config.h"
+#include "status.h"
+#include "string/string.h"
+#include "memory/memory.h"
+
+// Note: entries come from a fixed pool, the cache never touches the heap
+static struct dcache_entry dcache_entries[PEACHOS_DCACHE_MAX_ENTRIES];
+static struct dcache_entry* dcache_buckets[PEACHOS_DCACHE_BUCKETS];
+static struct dcache_entry* dcache_lru_head = 0;
+static struct dcache_entry* dcache_lru_tail = 0;
+
+// Note: names compare case-insensitive (FAT does), so they hash case-insensitive too
+static unsigned int dcache_hash(const void* parent_key, const char* name)
+{
+    unsigned int hash = (unsigned int) parent_key;
+    while (*name)
+    {
+        hash = hash * 31 + tolower(*name);
+        name++;
+    }
+
+    return hash % PEACHOS_DCACHE_BUCKETS;
+}
+
+static void dcache_lru_unlink(struct dcache_entry* entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        dcache_lru_head = entry->lru_next;
+
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        dcache_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = 0;
+    entry->lru_next = 0;
+}
+
+static void dcache_lru_push_front(struct dcache_entry* entry)
+{
+    entry->lru_prev = 0;
+    entry->lru_next = dcache_lru_head;
+    if (dcache_lru_head)
+        dcache_lru_head->lru_prev = entry;
+    dcache_lru_head = entry;
+    if (!dcache_lru_tail)
+        dcache_lru_tail = entry;
+}
+
+// Note: takes the entry out of the cache and frees its object, the reference it held on its parent goes too
+static void dcache_evict(struct dcache_entry* entry)
+{
+    struct dcache_entry** link = &dcache_buckets[dcache_hash(entry->parent_key, entry->name)];
+    while (*link && *link != entry)
+    {
+        link = &(*link)->hash_next;
+    }
+    if (*link)
+    {
+        *link = entry->hash_next;
+    }
+
+    dcache_lru_unlink(entry);
+    if (entry->object && entry->release)
+    {
+        entry->release(entry->object);
+    }
+
+    struct dcache_entry* parent = entry->parent;
+    memset(entry, 0, sizeof(struct dcache_entry));
+    if (parent)
+    {
+        dcache_put(parent);
+    }
+}
+
+// Note: a free slot of the pool, evicting the least recently used unreferenced entry when there is none
+static struct dcache_entry* dcache_new_entry()
+{
+    for (int i = 0; i < PEACHOS_DCACHE_MAX_ENTRIES; i++)
+    {
+        if (!dcache_entries[i].used)
+        {
+            return &dcache_entries[i];
+        }
+    }
+
+    for (struct dcache_entry* entry = dcache_lru_tail; entry; entry = entry->lru_prev)
+    {
+        if (entry->refcount == 0)
+        {
+            dcache_evict(entry);
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+static struct dcache_entry* dcache_find(const void* parent_key, const char* name)
+{
+    struct dcache_entry* entry = dcache_buckets[dcache_hash(parent_key, name)];
+    while (entry)
+    {
+        if (entry->parent_key == parent_key && istrncmp(entry->name, name, PEACHOS_DCACHE_MAX_NAME) == 0)
+        {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+
+    return 0;
+}
+
+// Note: returns the entry for (name) in the directory (parent_key) with a reference taken, or 0 when it is not cached
+// Note: a returned entry without an object means the name is known not to exist
+struct dcache_entry* dcache_lookup(const void* parent_key, const char* name)
+{
+    struct dcache_entry* entry = dcache_find(parent_key, name);
+    if (!entry)
+    {
+        return 0;
+    }
+
+    entry->refcount++;
+    dcache_lru_unlink(entry);
+    dcache_lru_push_front(entry);
+    return entry;
+}
+
+// Note: caches (object) under (name) in the directory (parent_key), pass a 0 object for a negative entry
+// Note: returns the entry with a reference taken, or 0 when the name is too long or every entry is in use (the caller keeps owning object then)
+struct dcache_entry* dcache_insert(const void* parent_key, struct dcache_entry* parent, const char* name, void* object, DCACHE_RELEASE_FUNCTION release)
+{
+    if (strlen(name) >= PEACHOS_DCACHE_MAX_NAME || dcache_find(parent_key, name))
+    {
+        return 0;
+    }
+
+    // Note: the parent may be the only unreferenced entry, we pin it before looking for a slot
+    if (parent)
+    {
+        parent->refcount++;
+    }
+
+    struct dcache_entry* entry = dcache_new_entry();
+    if (!entry)
+    {
+        if (parent)
+        {
+            parent->refcount--;
+        }
+        return 0;
+    }
+
+    entry->used = 1;
+    entry->parent_key = parent_key;
+    entry->parent = parent;
+    strncpy(entry->name, name, PEACHOS_DCACHE_MAX_NAME);
+    entry->object = object;
+    entry->release = release;
+    entry->refcount = 1;
+
+    unsigned int bucket = dcache_hash(parent_key, name);
+    entry->hash_next = dcache_buckets[bucket];
+    dcache_buckets[bucket] = entry;
+    dcache_lru_push_front(entry);
+    return entry;
+}
+
+// Note: drops a reference, the entry stays cached until it is evicted
+void dcache_put(struct dcache_entry* entry)
+{
+    if (!entry || entry->refcount <= 0)
+    {
+        return;
+    }
+
+    entry->refcount--;
+    if (entry->refcount == 0 && entry->stale)
+    {
+        dcache_evict(entry);
+    }
+}
+
+// Note: forgets (name) in the directory (parent_key), e.g. after it was created or removed
+// Note: an entry still in use is only unhashed, it is evicted once its last reference is gone
+void dcache_invalidate(const void* parent_key, const char* name)
+{
+    struct dcache_entry* entry = dcache_find(parent_key, name);
+    if (!entry)
+    {
+        return;
+    }
+
+    if (entry->refcount == 0)
+    {
+        dcache_evict(entry);
+        return;
+    }
+
+    // Here: we unhash it now so the next lookup misses, the slot is freed by the last dcache_put
+    struct dcache_entry** link = &dcache_buckets[dcache_hash(entry->parent_key, entry->name)];
+    while (*link != entry)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    entry->hash_next = 0;
+    entry->stale = 1;
+}
@@ -0,0 +1,40 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "config.h"
+
+typedef void (*DCACHE_RELEASE_FUNCTION)(void* object);
+
+// One cached name in a directory, either with the object it resolves to or negative (the name does not exist)
+struct dcache_entry
+{
+    // The directory object the name lives in, entries are keyed by (parent_key, name)
+    const void* parent_key;
+    // The parent's own entry if it is cached, we hold a reference on it so parent_key stays valid
+    struct dcache_entry* parent;
+    char name[PEACHOS_DCACHE_MAX_NAME];
+
+    // What the name resolves to, 0 for a negative entry
+    void* object;
+    // Frees the object once the entry is evicted
+    DCACHE_RELEASE_FUNCTION release;
+
+    // Users plus cached children, only entries at zero may be evicted
+    int refcount;
+
+    struct dcache_entry* hash_next;
+    // Most recently used first
+    struct dcache_entry* lru_prev;
+    struct dcache_entry* lru_next;
+    // Is this slot of the pool in use
+    int used;
+    // Invalidated while referenced: no longer found by lookups, evicted on the last put
+    int stale;
+};
+
+struct dcache_entry* dcache_lookup(const void* parent_key, const char* name);
+struct dcache_entry* dcache_insert(const void* parent_key, struct dcache_entry* parent, const char* name, void* object, DCACHE_RELEASE_FUNCTION release);
+void dcache_put(struct dcache_entry* entry);
+void dcache_invalidate(const void* parent_key, const char* name);
+
+#endif
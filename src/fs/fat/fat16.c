@@ -3,15 +3,25 @@
 #include "string/string.h"
 #include "disk/disk.h"
 #include "disk/streamer.h"
+#include "fs/dcache.h"
 #include "memory/heap/kheap.h"
 #include "memory/memory.h"
+#include "rtc/rtc.h"
 #include "status.h"
 #include <stdint.h>
 
 #define PEACHOS_FAT16_SIGNATURE 0x29
 #define PEACHOS_FAT16_FAT_ENTRY_SIZE 0x02
-#define PEACHOS_FAT16_BAD_SECTOR 0xFF7
-#define PEACHOS_FAT16_UNUSED 0x00
+#define PEACHOS_FAT16_UNUSED 0x0000
+// FAT16 entry values: 0xFFF0-0xFFF6 are reserved, 0xFFF7 marks a bad cluster, 0xFFF8 and up end a chain
+#define PEACHOS_FAT16_RESERVED 0xFFF0
+#define PEACHOS_FAT16_BAD_SECTOR 0xFFF7
+#define PEACHOS_FAT16_END_OF_CHAIN 0xFFF8
+// What we write to end a chain
+#define PEACHOS_FAT16_CHAIN_END 0xFFFF
+// Length of a raw 8.3 name: 8 bytes of name and 3 of extension, space padded, no dot
+#define PEACHOS_FAT16_NAME_LENGTH 11
+#define PEACHOS_FAT16_DELETED_ENTRY 0xE5
 
 
 typedef unsigned int FAT_ITEM_TYPE;
@@ -85,10 +95,31 @@ struct fat_directory_item
 
 struct fat_directory
 {
+    // The slots of the table as they are on disk, up to the first one that ends it (total) and all the table has room for (capacity)
     struct fat_directory_item* item;
     int total;
+    int capacity;
     int sector_pos;
     int ending_sector_pos;
+    // Subdirectories: the first cluster of their chain, 0 for the root directory
+    int first_cluster;
+
+    // Hash index over the 8.3 names of item[], built at load time: index_buckets[hash] is the first item + 1 (0 ends a chain)
+    // and index_next[i] the item after i in the same bucket, + 1
+    int* index_buckets;
+    int* index_next;
+    int index_size;
+
+    // Our entry in the dentry cache while it has one, the cache holds a reference then (0 for the root and uncached directories)
+    struct dcache_entry* dentry;
+    // Set on the root directory, it belongs to fat_private and is never freed through an item
+    int persistent;
+
+    // Subdirectories: items and the dentry cache holding the table, it is freed with the last reference
+    int refcount;
+    // Subdirectories: the other tables of the volume in memory, there is one per directory (see fat16_load_fat_directory)
+    struct fat_directory* next_loaded;
+    struct fat_directory** loaded_link;
 };
 
 struct fat_item
@@ -102,10 +133,36 @@ struct fat_item
     FAT_ITEM_TYPE type;
 };
 
+// A run of clusters of a file that follow each other on disk
+struct fat_extent
+{
+    // Index of the run's first cluster within the file
+    uint32_t file_cluster;
+    // Cluster number of that first cluster on disk
+    uint32_t disk_cluster;
+    uint32_t total_clusters;
+};
+
 struct fat_file_descriptor
 {
     struct fat_item* item;
+    // Open directories: the index of the next entry readdir hands out (files keep their position in the VFS)
     uint32_t pos;
+
+    // The file's cluster chain as runs sorted by file_cluster, built on first read (0 until then)
+    struct fat_extent* extents;
+    int total_extents;
+
+    // Files: the directory the file's entry is in, held so writes can update it, the entry's slot in it and where that is on disk
+    struct fat_item* parent;
+    int entry_index;
+    uint32_t entry_sector;
+    uint32_t entry_offset;
+    // Files: the disk they are on, close needs it to give back clusters reserved past the end of the file
+    struct disk* disk;
+    int preallocated;
+    // Files: written since the open, close stamps the entry with the time of the change and flushes the disk
+    int modified;
 };
 
 struct fat_private
@@ -121,24 +178,51 @@ struct fat_private
 
     // Used in situations where we stream the directory
     struct disk_stream* directory_stream;
+
+    // The first FAT, loaded whole at resolve time so chain walks never touch the disk
+    uint16_t* fat_table;
+    uint32_t fat_table_entries;
+    // One bit per FAT sector that was changed in memory and still has to be written back
+    uint8_t* fat_dirty;
+
+    // One bit per cluster, set when it is in use (or no cluster at all). Built from the FAT on the first allocation
+    uint32_t* cluster_map;
+    // Clusters 2..total_clusters-1 hold data, the FAT may have room for more than the volume has
+    uint32_t total_clusters;
+    uint32_t free_clusters;
+    // Where the next allocation starts looking, right after the last run we handed out
+    uint32_t next_free;
+
+    // Every subdirectory table in memory, found by first cluster so a directory is never loaded twice
+    struct fat_directory* loaded_directories;
 };
 
 int fat16_resolve(struct disk* disk);
-void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
-int fat16_read(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmemb, char* out_ptr);
-int fat16_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode);
+void* fat16_open(struct disk* disk, void* at, struct path_view* path, FILE_MODE mode);
+int fat16_read_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, char* out);
+int fat16_write_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, const char* in);
+int fat16_truncate(struct disk* disk, void* private, uint32_t size);
+int fat16_fallocate(struct disk* disk, void* private, uint32_t offset, uint32_t length);
 int fat16_stat(struct disk* disk, void* private, struct file_stat* stat);
 int fat16_close(void* private);
+uint32_t fat16_ino(struct disk* disk, void* private);
+void* fat16_opendir(struct disk* disk, void* at, struct path_view* path);
+int fat16_readdir(struct disk* disk, void* private, struct file_dirent* out, int max);
 
 
 struct filesystem fat16_fs =
 {
     .resolve = fat16_resolve,
     .open = fat16_open,
-    .read = fat16_read,
-    .seek = fat16_seek,
+    .read_at = fat16_read_at,
+    .write_at = fat16_write_at,
+    .truncate = fat16_truncate,
+    .fallocate = fat16_fallocate,
     .stat = fat16_stat,
-    .close = fat16_close
+    .close = fat16_close,
+    .ino = fat16_ino,
+    .opendir = fat16_opendir,
+    .readdir = fat16_readdir
 };
 
 struct filesystem* fat16_init()
@@ -157,61 +241,179 @@ static void fat16_init_private(struct disk* disk, struct fat_private* private)
 }
 
 // Get size in bytes from sector no.
-int fat16_sector_to_absolute(struct disk* disk, int sector)
+uint64_t fat16_sector_to_absolute(struct disk* disk, int sector)
 {
-    return sector * disk->sector_size;
+    return (uint64_t) sector * disk->sector_size;
 }
 
-// Note: Loops through the Data Cluster sector of the FAT16 Disk Layout and goes through each file and counts it.
-int fat16_get_total_items_for_directory(struct disk* disk, uint32_t directory_start_sector)
+static char fat16_fold(char c)
 {
-    struct fat_directory_item item;
-    struct fat_directory_item empty_item;
-    memset(&empty_item, 0, sizeof(empty_item));
-    
-    struct fat_private* fat_private = disk->fs_private;
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - ('a' - 'A');
+    }
+    return c;
+}
 
-    int res = 0;
-    int i = 0;
-    int directory_start_pos = directory_start_sector * disk->sector_size; // Meaning: right after the root directory part in the disk layout
-    struct disk_stream* stream = fat_private->directory_stream;
-    if(diskstreamer_seek(stream, directory_start_pos) != PEACHOS_ALL_OK)
+// Note: converts a path component such as "kernel.bin" into the raw upper-cased, space padded 11-byte form "KERNEL  BIN"
+// Note: returns -EBADPATH for names that cannot be an 8.3 name, those never match an entry
+static int fat16_name_to_raw(const char* name, char* out)
+{
+    memset(out, ' ', PEACHOS_FAT16_NAME_LENGTH);
+
+    // Here: "." and ".." are stored as they are
+    if (name[0] == '.' && (name[1] == 0x00 || (name[1] == '.' && name[2] == 0x00)))
     {
-        res = -EIO;
-        goto out;
+        out[0] = '.';
+        if (name[1] == '.')
+        {
+            out[1] = '.';
+        }
+        return 0;
     }
-    /* Here we loop through all the items. diskstreamer_read will read an item, then increment by size of item
-    So it can point to the next item. And so on. */
-    while(1)
+
+    int i = 0;
+    while (*name && *name != '.')
     {
-        if (diskstreamer_read(stream, &item, sizeof(item)) != PEACHOS_ALL_OK)
+        if (i >= 8)
         {
-            res = -EIO;
-            goto out;
+            return -EBADPATH;
         }
+        out[i++] = fat16_fold(*name++);
+    }
+
+    if (i == 0)
+    {
+        return -EBADPATH;
+    }
 
-        if (item.filename[0] == 0x00)
+    if (*name == '.')
+    {
+        name++;
+        i = 8;
+        while (*name)
         {
-            // We are done
-            break;
+            if (i >= PEACHOS_FAT16_NAME_LENGTH || *name == '.')
+            {
+                return -EBADPATH;
+            }
+            out[i++] = fat16_fold(*name++);
         }
+    }
 
-        // Is the item unused
-        if (item.filename[0] == 0xE5)
+    return 0;
+}
+
+// Note: (raw) is the 11-byte name as stored, entries hold their 8.3 names upper-cased so they hash like a folded request
+static unsigned int fat16_hash_raw_name(const char* raw)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < PEACHOS_FAT16_NAME_LENGTH; i++)
+    {
+        hash = (hash ^ (uint8_t) raw[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Note: compares filename and ext (they follow each other in the entry) a word at a time: two words of name, then the
+// extension as a half word and a byte. (raw) comes from fat16_name_to_raw, so it is upper-cased like the entry
+static int fat16_raw_name_equals(struct fat_directory_item* item, const char* raw)
+{
+    const uint8_t* name = item->filename;
+    return *(const uint32_t*) name == *(const uint32_t*) raw
+        && *(const uint32_t*) (name + 4) == *(const uint32_t*) (raw + 4)
+        && *(const uint16_t*) (name + 8) == *(const uint16_t*) (raw + 8)
+        && name[10] == (uint8_t) raw[10];
+}
+
+// Note: lookups only see files and directories. The first byte tells free and deleted entries, the attribute byte the
+// volume label and long name entries (those carry the volume label bit too), no name has to be looked at for that
+static int fat16_is_lookup_entry(struct fat_directory_item* item)
+{
+    return item->filename[0] != 0x00 && item->filename[0] != PEACHOS_FAT16_DELETED_ENTRY
+        && !(item->attribute & FAT_FILE_VOLUME_LABEL);
+}
+
+// Note: builds the name index of a loaded directory. Without one (no memory) lookups fall back to scanning the table
+static int fat16_build_directory_index(struct fat_directory* directory)
+{
+    // Here: a power of two at least as large as the table keeps chains short
+    int size = 16;
+    while (size < directory->total)
+    {
+        size <<= 1;
+    }
+
+    int* index = kzalloc((size + directory->total) * sizeof(int));
+    if (!index)
+    {
+        return -ENOMEM;
+    }
+
+    directory->index_buckets = index;
+    directory->index_next = index + size;
+    directory->index_size = size;
+
+    // Note: we insert backwards so the first of two entries with the same name is found first
+    for (int i = directory->total - 1; i >= 0; i--)
+    {
+        struct fat_directory_item* item = &directory->item[i];
+        if (!fat16_is_lookup_entry(item))
         {
             continue;
         }
 
-        i++; // So we can know the total number if items, and return it.
+        unsigned int bucket = fat16_hash_raw_name((const char*) item->filename) & (size - 1);
+        directory->index_next[i] = directory->index_buckets[bucket];
+        directory->index_buckets[bucket] = i + 1;
     }
 
-    res = i;
+    return 0;
+}
 
-out:
-    return res;
+// Note: the entry of (directory) whose 8.3 name is (raw), O(1) through the index, 0 if there is none
+static struct fat_directory_item* fat16_find_raw_name(struct fat_directory* directory, const char* raw)
+{
+    if (!directory->index_buckets)
+    {
+        for (int i = 0; i < directory->total; i++)
+        {
+            struct fat_directory_item* item = &directory->item[i];
+            if (fat16_is_lookup_entry(item) && fat16_raw_name_equals(item, raw))
+            {
+                return item;
+            }
+        }
+        return 0;
+    }
+
+    unsigned int bucket = fat16_hash_raw_name(raw) & (directory->index_size - 1);
+    for (int i = directory->index_buckets[bucket]; i; i = directory->index_next[i - 1])
+    {
+        if (fat16_raw_name_equals(&directory->item[i - 1], raw))
+        {
+            return &directory->item[i - 1];
+        }
+    }
+
+    return 0;
+}
+
+// Note: the number of slots of a freshly read directory table, it ends at the first entry starting with 0x00 or after (max)
+// Note: deleted entries stay where they are, so an entry's index is its slot on disk (lookups and listings skip them)
+static int fat16_directory_length(struct fat_directory_item* items, int max)
+{
+    int total = 0;
+    while (total < max && items[total].filename[0] != 0x00)
+    {
+        total++;
+    }
+
+    return total;
 }
 
 // Note: It fills in the root directory: builds the whole table of directories, total, pos, ending pos
+// Note: the root directory has a fixed place and size, so one read gets all of it
 int fat16_get_root_directory(struct disk* disk, struct fat_private* fat_private, struct fat_directory* directory)
 {   
     struct fat_directory_item* dir = 0x00;
@@ -220,13 +422,6 @@ int fat16_get_root_directory(struct disk* disk, struct fat_private* fat_private,
     int root_dir_sector_pos = (primary_header->fat_copies * primary_header->sectors_per_fat) + primary_header->reserved_sectors;
     int root_dir_entries = fat_private->header.primary_header.root_dir_entries;
     int root_dir_size = (root_dir_entries * sizeof(struct fat_directory_item));
-    int total_sectors = root_dir_size / disk->sector_size;
-    if (root_dir_size % disk->sector_size)
-    {
-        total_sectors += 1;
-    }
-
-    int total_items = fat16_get_total_items_for_directory(disk, root_dir_sector_pos);
 
     dir = kzalloc(root_dir_size);
     // Check: for memory
@@ -250,9 +445,12 @@ int fat16_get_root_directory(struct disk* disk, struct fat_private* fat_private,
     }
 
     directory->item = dir;
-    directory->total = total_items;
+    directory->total = fat16_directory_length(dir, root_dir_entries);
+    directory->capacity = root_dir_entries;
     directory->sector_pos = root_dir_sector_pos;
     directory->ending_sector_pos = root_dir_sector_pos + (root_dir_size / disk->sector_size);
+    fat16_build_directory_index(directory);
+    directory->persistent = 1;
     out:
         return res;
     err_out:
@@ -262,11 +460,92 @@ int fat16_get_root_directory(struct disk* disk, struct fat_private* fat_private,
         return res;
 }
 
+// Note: reads the whole first FAT (sectors_per_fat sectors right after the reserved sectors) into memory with one read
+static int fat16_load_fat_table(struct disk* disk, struct fat_private* fat_private)
+{
+    struct fat_header* primary_header = &fat_private->header.primary_header;
+    int fat_size = primary_header->sectors_per_fat * disk->sector_size;
+    int total_sectors = primary_header->sectors_per_fat;
+
+    fat_private->fat_table = kmalloc(fat_size);
+    fat_private->fat_dirty = kzalloc((total_sectors + 7) / 8);
+    if (!fat_private->fat_table || !fat_private->fat_dirty)
+    {
+        return -ENOMEM;
+    }
+
+    struct disk_stream* stream = fat_private->fat_read_stream;
+    if (diskstreamer_seek(stream, fat16_sector_to_absolute(disk, primary_header->reserved_sectors)) != PEACHOS_ALL_OK)
+    {
+        return -EIO;
+    }
+
+    if (diskstreamer_read(stream, fat_private->fat_table, fat_size) != PEACHOS_ALL_OK)
+    {
+        return -EIO;
+    }
+
+    fat_private->fat_table_entries = fat_size / PEACHOS_FAT16_FAT_ENTRY_SIZE;
+    return 0;
+}
+
+static void fat16_free_fat_table(struct fat_private* fat_private)
+{
+    if (fat_private->fat_table)
+    {
+        kfree(fat_private->fat_table);
+        fat_private->fat_table = 0;
+    }
+
+    if (fat_private->fat_dirty)
+    {
+        kfree(fat_private->fat_dirty);
+        fat_private->fat_dirty = 0;
+    }
+}
+
+// Note: frees what fat16_resolve built of a volume it then turned down: the root directory table, the FAT and the streams
+static void fat16_free_private(struct fat_private* fat_private)
+{
+    if (fat_private->root_directory.item)
+    {
+        kfree(fat_private->root_directory.item);
+    }
+
+    if (fat_private->root_directory.index_buckets)
+    {
+        kfree(fat_private->root_directory.index_buckets);
+    }
+
+    fat16_free_fat_table(fat_private);
+
+    if (fat_private->cluster_read_stream)
+    {
+        diskstreamer_close(fat_private->cluster_read_stream);
+    }
+
+    if (fat_private->fat_read_stream)
+    {
+        diskstreamer_close(fat_private->fat_read_stream);
+    }
+
+    if (fat_private->directory_stream)
+    {
+        diskstreamer_close(fat_private->directory_stream);
+    }
+
+    kfree(fat_private);
+}
+
 // Note: This function basically creates and initializes the fs_private structure of the disk
 int fat16_resolve(struct disk* disk)
 {
     int res = 0;
     struct fat_private* fat_private = kzalloc(sizeof(struct fat_private));
+    if (!fat_private)
+    {
+        return -ENOMEM;
+    }
     // (3) Here: we get stream cluster_read_stream
     // (4) Here: we get stream fat_read_stream
     // (5) Here: we get directory_stream
@@ -300,6 +579,12 @@ int fat16_resolve(struct disk* disk)
         res = -EIO;
         goto out;
     }
+    // (6) Here: we load the FAT, from now on following a cluster chain is a memory lookup
+    res = fat16_load_fat_table(disk, fat_private);
+    if (res < 0)
+    {
+        goto out;
+    }
 
 out:
     if (stream)
@@ -309,7 +594,7 @@ out:
 
     if (res < 0)
     {
-        kfree(fat_private);
+        fat16_free_private(fat_private);
         disk->fs_private = 0;
     }
     return res;
@@ -379,36 +664,61 @@ static int fat16_cluster_to_sector(struct fat_private* private, int cluster) {
     return private->root_directory.ending_sector_pos + ((cluster - 2) * private->header.primary_header.sectors_per_cluster);
 }
 
-// Note: goes to the privates header and get the number of reserved sectors
-// Note: beacuse we know the first FAT table is stored after the reserved sector
-static uint32_t fat16_get_first_fat_sector(struct fat_private* private) {
-    return private->header.primary_header.reserved_sectors;
-}
-
+// Note: the FAT entry of (cluster) straight out of the in-memory table
 static int fat16_get_fat_entry(struct disk* disk, int cluster) {
-    int res = -1;
     struct fat_private* private = disk->fs_private;
-    struct disk_stream* stream = private->fat_read_stream;
-    if (!stream) {
-        goto out;
+    if (cluster < 0 || cluster >= private->fat_table_entries) {
+        return -EIO;
     }
-    uint32_t fat_table_position = fat16_get_first_fat_sector(private) * disk->sector_size;
-    // Note: so if it is cluster 2, in the FAT table we go to 2*0x02
-    res = diskstreamer_seek(stream, fat_table_position * (cluster * PEACHOS_FAT16_FAT_ENTRY_SIZE));
-    if (res < 0) {
-        goto out;
+
+    return private->fat_table[cluster];
+}
+
+// Note: changes a FAT entry in memory and marks its sector dirty, fat16_sync_fat_table writes dirty sectors back
+static int fat16_set_fat_entry(struct disk* disk, int cluster, uint16_t value) {
+    struct fat_private* private = disk->fs_private;
+    if (cluster < 2 || cluster >= private->fat_table_entries) {
+        return -EINVARG;
     }
-    
-    uint16_t result = 0;
-    res = diskstreamer_read(stream, &result, sizeof(result));
-    if (res < 0) {
-        goto out;
+
+    private->fat_table[cluster] = value;
+    int sector = (cluster * PEACHOS_FAT16_FAT_ENTRY_SIZE) / disk->sector_size;
+    private->fat_dirty[sector / 8] |= 1 << (sector % 8);
+    return 0;
+}
+
+// Note: write-back hook for dirty FAT sectors, every dirty sector is handed to (write_sector) with its FAT relative number
+// Note: the sector stays dirty when writing it failed
+static int fat16_sync_fat_table(struct disk* disk, int (*write_sector)(struct disk* disk, int fat_sector, void* buf)) {
+    struct fat_private* private = disk->fs_private;
+    int res = 0;
+    int total_sectors = private->header.primary_header.sectors_per_fat;
+    for (int sector = 0; sector < total_sectors; sector++) {
+        if (!(private->fat_dirty[sector / 8] & (1 << (sector % 8)))) {
+            continue;
+        }
+
+        res = write_sector(disk, sector, (void*) private->fat_table + sector * disk->sector_size);
+        if (res < 0) {
+            break;
+        }
+        private->fat_dirty[sector / 8] &= ~(1 << (sector % 8));
     }
 
-    res = result;
+    return res;
+}
 
-    out:
-        return res;
+// Note: does the FAT in memory have changes fat16_sync_fat_table has not written yet
+static int fat16_fat_dirty(struct disk* disk) {
+    struct fat_private* private = disk->fs_private;
+    int total_bytes = (private->header.primary_header.sectors_per_fat + 7) / 8;
+    for (int i = 0; i < total_bytes; i++) {
+        if (private->fat_dirty[i]) {
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
 // Note: get correct cluster to use based on the starting cluster and offset
@@ -425,9 +735,13 @@ static int fat16_get_cluster_for_offset(struct disk* disk, int starting_cluster,
         addresses linked together, or it will have some error value or end of file value indicating there is no
         more sectors for this file*/
         int entry = fat16_get_fat_entry(disk, cluster_to_use);
+        if (entry < 0) {
+            res = entry;
+            goto out;
+        }
 
         // Check: is this the last entry of the file
-        if (entry == 0xFF8 || entry == 0xFFF) {
+        if (entry >= PEACHOS_FAT16_END_OF_CHAIN) {
             res = -EIO;
             goto out;
         }
@@ -439,14 +753,14 @@ static int fat16_get_cluster_for_offset(struct disk* disk, int starting_cluster,
         }
 
         // Check: is it a reserved sector
-        if (entry == 0xFF0 || entry == 0xFF6) {
+        if (entry >= PEACHOS_FAT16_RESERVED) {
             res = -EIO;
             goto out;
         }
 
         // Check: FAT table corrupted?
-        // Note: cluster number cannot be 0 because it starts from 2
-        if (entry == 0x00) {
+        // Note: cluster number cannot be 0 or 1 because it starts from 2
+        if (entry < 2) {
             res = -EIO;
             goto out;
         }
@@ -459,131 +773,777 @@ static int fat16_get_cluster_for_offset(struct disk* disk, int starting_cluster,
         return res;
 }
 
-/* Note: this is responsible for reading a cluster given the stream, offet in the cluster, to the out buffer*/
+/* Note: this is responsible for reading (total) bytes from (offset) of the cluster chain starting at (cluster), given the stream*/
+// Note: the chain is walked once up to offset, after that we follow it as we go and read each run of contiguous clusters in one go
 static int fat16_read_internal_from_stream(struct disk* disk, struct disk_stream* stream, int cluster, int offset, int total, void* out) {
     int res = 0;
     struct fat_private* private = disk->fs_private;
     int size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
     int cluster_to_use = fat16_get_cluster_for_offset(disk, cluster, offset);
-    if (cluster_to_use < 0) {
-        res = cluster_to_use;
-        goto out;
-    }
-
     int offset_from_cluster = offset % size_of_cluster_bytes;
 
-    int starting_sector = fat16_cluster_to_sector(private, cluster_to_use);
+    while (total > 0) {
+        if (cluster_to_use < 0) {
+            res = cluster_to_use;
+            goto out;
+        }
+
+        // Here: we grow the run while we need more and the chain continues with the very next cluster
+        int run_clusters = 1;
+        int next_cluster = 0;
+        while (run_clusters * size_of_cluster_bytes - offset_from_cluster < total) {
+            next_cluster = fat16_get_cluster_for_offset(disk, cluster_to_use + run_clusters - 1, size_of_cluster_bytes);
+            if (next_cluster != cluster_to_use + run_clusters) {
+                break;
+            }
+            run_clusters++;
+        }
 
-    // Here: we get the absolute position in bytes. from sector number
-    int starting_pos = (starting_sector*disk->sector_size) + offset_from_cluster;
+        int starting_sector = fat16_cluster_to_sector(private, cluster_to_use);
 
-    // Here: basically we want to read every file in the subdirectory/folder
-    /* Note: we can only read a single sector at a time. If more than a sector, we have to go back to the FAT table
-    and get the address of the next sector as well */ 
-    int total_to_read = total > size_of_cluster_bytes ? size_of_cluster_bytes : total;
+        // Here: we get the absolute position in bytes. from sector number
+        uint64_t starting_pos = fat16_sector_to_absolute(disk, starting_sector) + offset_from_cluster;
 
-    // Here: we point to that location and read
-    res = diskstreamer_seek(stream, starting_pos);
-    if (res != PEACHOS_ALL_OK) {
-        goto out;
-    }
-    res = diskstreamer_read(stream, out, total_to_read);
-    if (res != PEACHOS_ALL_OK) {
-        goto out;
-    }
+        int total_to_read = run_clusters * size_of_cluster_bytes - offset_from_cluster;
+        if (total_to_read > total) {
+            total_to_read = total;
+        }
+
+        // Here: we point to that location and read
+        res = diskstreamer_seek(stream, starting_pos);
+        if (res != PEACHOS_ALL_OK) {
+            goto out;
+        }
+        res = diskstreamer_read(stream, out, total_to_read);
+        if (res != PEACHOS_ALL_OK) {
+            goto out;
+        }
 
-    // we adjust the total value, maybe there is more to read...
-    total -= total_to_read; 
-    // Check: is there more clusters to read?
-    if (total > 0) {
-        res = fat16_read_internal_from_stream(disk, stream, cluster, offset+total_to_read, total, out+total_to_read);
+        total -= total_to_read;
+        out += total_to_read;
+        offset_from_cluster = 0;
+
+        // Note: if there is more to read the run ended early, and next_cluster is where the chain goes on
+        cluster_to_use = next_cluster;
     }
     out:
         return res;
 }
 
-/* Note: this is responsible for reading a cluster given the offet in the cluster, to the out buffer*/
-static int fat16_read_internal(struct disk* disk, int starting_cluster, int offset, int total, void* out) {
-    struct fat_private* fs_private = disk->fs_private;
-    struct disk_stream* stream = fs_private->cluster_read_stream;
-    return fat16_read_internal_from_stream(disk, stream, starting_cluster, offset, total, out);
-}
+// Note: walks the cluster chain from (first_cluster) once and counts its runs of contiguous clusters, filling in (extents) when given
+static int fat16_walk_extents(struct disk* disk, int first_cluster, struct fat_extent* extents) {
+    struct fat_private* private = disk->fs_private;
+    int total_extents = 0;
+    uint32_t file_cluster = 0;
+    int cluster = first_cluster;
+    int run_end = -1;
+
+    while (1) {
+        // Check: a chain longer than the FAT has a loop in it
+        if (cluster < 2 || cluster >= PEACHOS_FAT16_RESERVED || file_cluster >= private->fat_table_entries) {
+            return -EIO;
+        }
 
-// Note: just frees up the space in the heap. Because we create the directory using kzalloc
-void fat16_free_directory(struct fat_directory* directory) {
-    if (!directory) {
-        return;
-    }
+        // Here: a cluster that does not follow the last one starts a new run
+        if (cluster != run_end) {
+            if (extents) {
+                extents[total_extents].file_cluster = file_cluster;
+                extents[total_extents].disk_cluster = cluster;
+                extents[total_extents].total_clusters = 0;
+            }
+            total_extents++;
+        }
 
-    if (directory->item) {
-        kfree(directory->item);
+        if (extents) {
+            extents[total_extents - 1].total_clusters++;
+        }
+        run_end = cluster + 1;
+        file_cluster++;
+
+        int next = fat16_get_fat_entry(disk, cluster);
+        if (next < 0) {
+            return next;
+        }
+
+        if (next >= PEACHOS_FAT16_END_OF_CHAIN) {
+            break;
+        }
+        cluster = next;
     }
 
-    kfree(directory);
+    return total_extents;
 }
 
-// Note: Note: just frees up the space in the heap. Because we create the files using kzalloc
-void fat16_fat_item_free(struct fat_item* item) {
-    if (item->type == FAT_ITEM_TYPE_DIRECTORY) {
-        fat16_free_directory(item->directory);
-    }
+// Note: the number of clusters in the chain from (first_cluster)
+static int fat16_count_clusters(struct disk* disk, int first_cluster) {
+    struct fat_private* private = disk->fs_private;
+    int total = 0;
+    int cluster = first_cluster;
+    while (1) {
+        // Check: a chain longer than the FAT has a loop in it
+        if (cluster < 2 || cluster >= PEACHOS_FAT16_RESERVED || total >= private->fat_table_entries) {
+            return -EIO;
+        }
+        total++;
 
-    else if (item->type == FAT_ITEM_TYPE_FILE) {
-        kfree(item->item);
+        int next = fat16_get_fat_entry(disk, cluster);
+        if (next < 0) {
+            return next;
+        }
+
+        if (next >= PEACHOS_FAT16_END_OF_CHAIN) {
+            break;
+        }
+        cluster = next;
     }
 
-    kfree(item);
+    return total;
 }
 
-/* Note: This function is supposed to take a fat_directory_item that is really a directory. And then go to 
-where this file/directory is pointing to to get to the real directory, and giving us that directory as a 
-structure fat_directory */
-// Note: we are coverting fat_directory_item to fat_directory!!!
-struct fat_directory* fat16_load_fat_directory(struct disk* disk, struct fat_directory_item* item) {
-
-    int res = 0;
-    struct fat_directory* directory = 0; // This is what we are aiming for
-    struct fat_private* fat_private = disk->fs_private; // We need the infos
+// Note: builds the extent list of the file, once
+static int fat16_load_extents(struct disk* disk, struct fat_file_descriptor* descriptor) {
+    if (descriptor->extents) {
+        return 0;
+    }
 
-    // Check: if the fat_directory_item is a sub-directory (again?)
-    if (!(item->attribute & FAT_FILE_SUBDIRECTORY)) {
-        res = -EINVARG;
-        goto out;
+    // Check: only files have a chain we read through a descriptor
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE) {
+        return -EINVARG;
     }
 
-    // Here: if it is a sub-directory
-    directory = kzalloc(sizeof(struct fat_directory));
-    // Check: if enough memory
-    if (!directory) {
-        res = -ENOMEM;
-        goto out;
+    // Note: an empty file has no clusters at all
+    int first_cluster = fat16_get_first_cluster(descriptor->item->item);
+    if (first_cluster == PEACHOS_FAT16_UNUSED) {
+        return 0;
     }
 
-    // Remember: cluster address starts from 2.
-    // Remember: here the item is of directory type
-    int cluster = fat16_get_first_cluster(item); // we get cluster numebr of fat_directory here from fat_directory_item
-    int cluster_sector = fat16_cluster_to_sector(fat_private, cluster); // Convert cluster no to sector number
-    int total_items = fat16_get_total_items_for_directory(disk, cluster_sector);
-    directory->total = total_items;
-    int directory_size = directory->total * sizeof(struct fat_directory_item);
-    directory->item = kzalloc(directory_size);
-    if (!directory->item)
-    {
-        res = -ENOMEM;
-        goto out;
+    int total = fat16_walk_extents(disk, first_cluster, 0);
+    if (total < 0) {
+        return total;
     }
 
-    /* Here: we read the whole fat_directory_item of the fat_directory, which is basically a list of all the items 
-    in that directory. So bunch of entries of structure fat_directory_item.*/
-    res = fat16_read_internal(disk, cluster, 0x00, directory_size, directory->item);
-    if (res != PEACHOS_ALL_OK)
-    {
-        goto out;
+    struct fat_extent* extents = kzalloc(sizeof(struct fat_extent) * total);
+    if (!extents) {
+        return -ENOMEM;
     }
 
-    out:
+    fat16_walk_extents(disk, first_cluster, extents);
+    descriptor->extents = extents;
+    descriptor->total_extents = total;
+    return 0;
+}
+
+// Note: binary search for the run holding cluster (file_cluster) of the file
+static struct fat_extent* fat16_find_extent(struct fat_file_descriptor* descriptor, uint32_t file_cluster) {
+    int low = 0;
+    int high = descriptor->total_extents - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        struct fat_extent* extent = &descriptor->extents[middle];
+        if (file_cluster < extent->file_cluster) {
+            high = middle - 1;
+        }
+        else if (file_cluster >= extent->file_cluster + extent->total_clusters) {
+            low = middle + 1;
+        }
+        else {
+            return extent;
+        }
+    }
+
+    return 0;
+}
+
+// Note: reads (total) bytes from (offset) of an open file, one streamed read per run of contiguous clusters
+static int fat16_read_extents(struct disk* disk, struct fat_file_descriptor* descriptor, int offset, int total, void* out) {
+    struct fat_private* private = disk->fs_private;
+    struct disk_stream* stream = private->cluster_read_stream;
+    int size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+
+    int res = fat16_load_extents(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    while (total > 0) {
+        uint32_t file_cluster = offset / size_of_cluster_bytes;
+        int offset_from_cluster = offset % size_of_cluster_bytes;
+        struct fat_extent* extent = fat16_find_extent(descriptor, file_cluster);
+        if (!extent) {
+            return -EIO;
+        }
+
+        // Here: everything from offset to the end of the run is one piece on disk
+        int disk_cluster = extent->disk_cluster + (file_cluster - extent->file_cluster);
+        int total_to_read = (extent->file_cluster + extent->total_clusters - file_cluster) * size_of_cluster_bytes - offset_from_cluster;
+        if (total_to_read > total) {
+            total_to_read = total;
+        }
+
+        uint64_t starting_pos = fat16_sector_to_absolute(disk, fat16_cluster_to_sector(private, disk_cluster)) + offset_from_cluster;
+        res = diskstreamer_seek(stream, starting_pos);
+        if (res != PEACHOS_ALL_OK) {
+            return res;
+        }
+        res = diskstreamer_read(stream, out, total_to_read);
+        if (res != PEACHOS_ALL_OK) {
+            return res;
+        }
+
+        offset += total_to_read;
+        out += total_to_read;
+        total -= total_to_read;
+    }
+
+    return 0;
+}
+
+/* Note: this is responsible for reading a cluster given the offet in the cluster, to the out buffer*/
+static int fat16_read_internal(struct disk* disk, int starting_cluster, int offset, int total, void* out) {
+    struct fat_private* fs_private = disk->fs_private;
+    struct disk_stream* stream = fs_private->cluster_read_stream;
+    return fat16_read_internal_from_stream(disk, stream, starting_cluster, offset, total, out);
+}
+
+// Note: writes FAT sector (fat_sector) to every copy of the FAT, the copies are kept the same
+static int fat16_write_fat_sector(struct disk* disk, int fat_sector, void* buf) {
+    struct fat_private* private = disk->fs_private;
+    struct fat_header* primary_header = &private->header.primary_header;
+    for (int copy = 0; copy < primary_header->fat_copies; copy++) {
+        int res = disk_write_block(disk, primary_header->reserved_sectors + copy * primary_header->sectors_per_fat + fat_sector, 1, buf);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+// Note: builds the cluster map from the FAT, once. Volumes that are only read never need it
+static int fat16_load_cluster_map(struct disk* disk) {
+    struct fat_private* private = disk->fs_private;
+    if (private->cluster_map) {
+        return 0;
+    }
+
+    // Here: the clusters are what is left of the volume after the root directory
+    struct fat_header* primary_header = &private->header.primary_header;
+    uint32_t total_sectors = primary_header->number_of_sectors ? primary_header->number_of_sectors : primary_header->sectors_big;
+    uint32_t data_start = private->root_directory.ending_sector_pos;
+    uint32_t total_clusters = total_sectors > data_start ? (total_sectors - data_start) / primary_header->sectors_per_cluster + 2 : 2;
+    if (total_clusters > private->fat_table_entries) {
+        total_clusters = private->fat_table_entries;
+    }
+    if (total_clusters > PEACHOS_FAT16_RESERVED) {
+        total_clusters = PEACHOS_FAT16_RESERVED;
+    }
+
+    uint32_t words = (total_clusters + 31) / 32;
+    uint32_t* map = kzalloc(words * sizeof(uint32_t));
+    if (!map) {
+        return -ENOMEM;
+    }
+
+    // Note: clusters 0 and 1 do not exist, and the bits past the last cluster are set so a scan never hands them out
+    private->free_clusters = 0;
+    for (uint32_t cluster = 0; cluster < words * 32; cluster++) {
+        if (cluster < 2 || cluster >= total_clusters || private->fat_table[cluster] != PEACHOS_FAT16_UNUSED) {
+            map[cluster / 32] |= 1u << (cluster % 32);
+        } else {
+            private->free_clusters++;
+        }
+    }
+
+    private->cluster_map = map;
+    private->total_clusters = total_clusters;
+    private->next_free = 2;
+    return 0;
+}
+
+static int fat16_cluster_in_use(struct fat_private* private, uint32_t cluster) {
+    return private->cluster_map[cluster / 32] & (1u << (cluster % 32));
+}
+
+// Note: the first free cluster at or after (start), 0 when there is none. Words with every cluster in use are skipped whole
+static uint32_t fat16_next_free_cluster(struct fat_private* private, uint32_t start) {
+    uint32_t cluster = start;
+    while (cluster < private->total_clusters) {
+        // Here: the clusters of the word before (cluster) count as used
+        uint32_t word = private->cluster_map[cluster / 32] | ((1u << (cluster % 32)) - 1);
+        if (word != 0xFFFFFFFF) {
+            return (cluster / 32) * 32 + __builtin_ctz(~word);
+        }
+        cluster = (cluster / 32 + 1) * 32;
+    }
+
+    return 0;
+}
+
+// Note: how many free clusters follow each other from (start), counting no further than (max)
+static uint32_t fat16_free_run_length(struct fat_private* private, uint32_t start, uint32_t max) {
+    uint32_t length = 0;
+    while (length < max && start + length < private->total_clusters && !fat16_cluster_in_use(private, start + length)) {
+        length++;
+    }
+
+    return length;
+}
+
+/* Note: finds room for (want) clusters of a file whose chain would go on at (goal): right there when it is free, so the
+file stays in one piece, else the first run from the allocation hint that takes them all, else the longest run there is.
+Returns the run's first cluster and its length in (length), 0 when nothing is free */
+static uint32_t fat16_find_free_run(struct fat_private* private, uint32_t goal, uint32_t want, uint32_t* length) {
+    if (goal >= 2 && goal < private->total_clusters && !fat16_cluster_in_use(private, goal)) {
+        *length = fat16_free_run_length(private, goal, want);
+        return goal;
+    }
+
+    uint32_t best = 0;
+    uint32_t best_length = 0;
+    // Here: two passes, from the hint to the last cluster and from the first cluster to the hint
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t cluster = pass == 0 ? private->next_free : 2;
+        uint32_t end = pass == 0 ? private->total_clusters : private->next_free;
+        while ((cluster = fat16_next_free_cluster(private, cluster)) && cluster < end) {
+            uint32_t run = fat16_free_run_length(private, cluster, want);
+            if (run == want) {
+                *length = run;
+                return cluster;
+            }
+
+            if (run > best_length) {
+                best = cluster;
+                best_length = run;
+            }
+            cluster += run;
+        }
+    }
+
+    *length = best_length;
+    return best;
+}
+
+// Note: adds the run of (total) clusters from (disk_cluster) to the end of the file's extents, growing the last one when it follows on
+static int fat16_append_extent(struct fat_file_descriptor* descriptor, uint32_t disk_cluster, uint32_t total) {
+    struct fat_extent* last = descriptor->total_extents ? &descriptor->extents[descriptor->total_extents - 1] : 0;
+    if (last && last->disk_cluster + last->total_clusters == disk_cluster) {
+        last->total_clusters += total;
+        return 0;
+    }
+
+    struct fat_extent* extents = kzalloc(sizeof(struct fat_extent) * (descriptor->total_extents + 1));
+    if (!extents) {
+        return -ENOMEM;
+    }
+
+    if (last) {
+        memcpy(extents, descriptor->extents, sizeof(struct fat_extent) * descriptor->total_extents);
+        kfree(descriptor->extents);
+    }
+
+    extents[descriptor->total_extents].file_cluster = last ? last->file_cluster + last->total_clusters : 0;
+    extents[descriptor->total_extents].disk_cluster = disk_cluster;
+    extents[descriptor->total_extents].total_clusters = total;
+    descriptor->extents = extents;
+    descriptor->total_extents++;
+    return 0;
+}
+
+static void fat16_drop_extents(struct fat_file_descriptor* descriptor) {
+    if (descriptor->extents) {
+        kfree(descriptor->extents);
+    }
+    descriptor->extents = 0;
+    descriptor->total_extents = 0;
+}
+
+/* Note: takes (total) free clusters and links them after (last), the end of a chain (0 starts a new one), the first new
+cluster goes to (first). The runs are as long as the free space allows, and when (descriptor) is given its extents grow
+with them. Only the FAT in memory changes, fat16_sync_fat_table writes it out */
+static int fat16_allocate_clusters(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t last, uint32_t total, uint32_t* first) {
+    struct fat_private* private = disk->fs_private;
+    int res = fat16_load_cluster_map(disk);
+    if (res < 0) {
+        return res;
+    }
+
+    // Check: the volume has room for all of them, so we never stop half way
+    if (total > private->free_clusters) {
+        return -ENOMEM;
+    }
+
+    uint32_t prev = last;
+    *first = 0;
+    while (total > 0) {
+        uint32_t length = 0;
+        uint32_t start = fat16_find_free_run(private, prev ? prev + 1 : 0, total, &length);
+        if (length == 0) {
+            return -EIO;
+        }
+
+        for (uint32_t cluster = start; cluster < start + length; cluster++) {
+            // Here: the new cluster ends the chain before the one in front of it points at it
+            fat16_set_fat_entry(disk, cluster, PEACHOS_FAT16_CHAIN_END);
+            if (prev) {
+                fat16_set_fat_entry(disk, prev, cluster);
+            }
+            if (!*first) {
+                *first = cluster;
+            }
+            private->cluster_map[cluster / 32] |= 1u << (cluster % 32);
+            prev = cluster;
+        }
+
+        private->free_clusters -= length;
+        private->next_free = start + length;
+        total -= length;
+
+        if (descriptor) {
+            res = fat16_append_extent(descriptor, start, length);
+            if (res < 0) {
+                // Note: the extents are built again from the FAT on the next use
+                fat16_drop_extents(descriptor);
+                descriptor = 0;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Note: gives the chain from (cluster) on back, in the FAT and in the cluster map when there is one
+static int fat16_free_chain(struct disk* disk, uint32_t cluster) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t total = 0;
+    while (cluster >= 2 && cluster < PEACHOS_FAT16_RESERVED) {
+        // Check: a chain longer than the FAT has a loop in it
+        if (total++ >= private->fat_table_entries) {
+            return -EIO;
+        }
+
+        int next = fat16_get_fat_entry(disk, cluster);
+        if (next < 0) {
+            return next;
+        }
+
+        fat16_set_fat_entry(disk, cluster, PEACHOS_FAT16_UNUSED);
+        if (private->cluster_map && cluster < private->total_clusters) {
+            private->cluster_map[cluster / 32] &= ~(1u << (cluster % 32));
+            private->free_clusters++;
+        }
+        cluster = next;
+    }
+
+    return 0;
+}
+
+// Note: writes (total) bytes at (offset) of sector (sector), the rest of the sector is read first and written back as it was
+// Note: a (fresh) sector holds nothing worth keeping, e.g. one past the end of the file, it is not read and the rest is zero
+static int fat16_write_partial_sector(struct disk* disk, uint32_t sector, uint32_t offset, const void* in, uint32_t total, int fresh) {
+    char* buf = fresh ? kzalloc(disk->sector_size) : kmalloc(disk->sector_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    int res = fresh ? 0 : disk_read_block(disk, sector, 1, buf);
+    if (res >= 0) {
+        memcpy(buf + offset, (void*) in, total);
+        res = disk_write_block(disk, sector, 1, buf);
+    }
+
+    kfree(buf);
+    return res;
+}
+
+// Note: the clusters the file's chain has, its extents must be loaded
+static uint32_t fat16_chain_clusters(struct fat_file_descriptor* descriptor) {
+    if (!descriptor->total_extents) {
+        return 0;
+    }
+
+    struct fat_extent* last = &descriptor->extents[descriptor->total_extents - 1];
+    return last->file_cluster + last->total_clusters;
+}
+
+// Note: grows the file's chain until it has (clusters) clusters, in as few runs as the free space allows
+static int fat16_reserve_clusters(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t clusters) {
+    int res = fat16_load_extents(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    uint32_t have = fat16_chain_clusters(descriptor);
+    if (clusters <= have) {
+        return 0;
+    }
+
+    uint32_t last = 0;
+    if (have) {
+        struct fat_extent* extent = &descriptor->extents[descriptor->total_extents - 1];
+        last = extent->disk_cluster + extent->total_clusters - 1;
+    }
+
+    uint32_t first = 0;
+    res = fat16_allocate_clusters(disk, descriptor, last, clusters - have, &first);
+    if (!last && first) {
+        descriptor->item->item->high_16_bits_first_cluster = 0;
+        descriptor->item->item->low_16_bits_first_cluster = first;
+    }
+    return res;
+}
+
+// Note: gives back the clusters of the chain past the ones (size) bytes need, a file cut to nothing has no first cluster
+static int fat16_trim_chain(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t size) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int res = fat16_load_extents(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    uint32_t keep = size / size_of_cluster_bytes + (size % size_of_cluster_bytes != 0);
+    if (keep >= fat16_chain_clusters(descriptor)) {
+        return 0;
+    }
+
+    struct fat_directory_item* item = descriptor->item->item;
+    if (keep == 0) {
+        uint32_t first = fat16_get_first_cluster(item);
+        item->high_16_bits_first_cluster = 0;
+        item->low_16_bits_first_cluster = 0;
+        res = fat16_free_chain(disk, first);
+    } else {
+        struct fat_extent* extent = fat16_find_extent(descriptor, keep - 1);
+        uint32_t last = extent->disk_cluster + (keep - 1 - extent->file_cluster);
+        int next = fat16_get_fat_entry(disk, last);
+        res = next < 0 ? next : fat16_set_fat_entry(disk, last, PEACHOS_FAT16_CHAIN_END);
+        if (res >= 0) {
+            res = fat16_free_chain(disk, next);
+        }
+    }
+
+    fat16_drop_extents(descriptor);
+    return res;
+}
+
+/* Note: writes (total) bytes at (offset) of the clusters the file has, whole sectors go out in one write per run of
+contiguous clusters straight from (in). A partial sector at either end is read, patched and written back, unless it
+starts past the end of the file (its size is still the old one here) */
+static int fat16_write_extents(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t offset, uint32_t total, const char* in) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+
+    int res = fat16_load_extents(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    while (total > 0) {
+        uint32_t file_cluster = offset / size_of_cluster_bytes;
+        uint32_t offset_from_cluster = offset % size_of_cluster_bytes;
+        struct fat_extent* extent = fat16_find_extent(descriptor, file_cluster);
+        if (!extent) {
+            return -EIO;
+        }
+
+        int disk_cluster = extent->disk_cluster + (file_cluster - extent->file_cluster);
+        uint32_t sector = fat16_cluster_to_sector(private, disk_cluster) + offset_from_cluster / disk->sector_size;
+        uint32_t offset_from_sector = offset_from_cluster % disk->sector_size;
+        uint32_t chunk = (extent->file_cluster + extent->total_clusters - file_cluster) * size_of_cluster_bytes - offset_from_cluster;
+        if (chunk > total) {
+            chunk = total;
+        }
+
+        if (offset_from_sector || chunk < disk->sector_size) {
+            if (chunk > disk->sector_size - offset_from_sector) {
+                chunk = disk->sector_size - offset_from_sector;
+            }
+            int fresh = offset - offset_from_sector >= descriptor->item->item->filesize;
+            res = fat16_write_partial_sector(disk, sector, offset_from_sector, in, chunk, fresh);
+        } else {
+            chunk -= chunk % disk->sector_size;
+            res = disk_write_block(disk, sector, chunk / disk->sector_size, (void*) in);
+        }
+
+        if (res < 0) {
+            return res;
+        }
+
+        offset += chunk;
+        in += chunk;
+        total -= chunk;
+    }
+
+    return 0;
+}
+
+static uint16_t fat16_from_bcd(uint32_t value) {
+    return (value & 0x0F) + (value >> 4) * 10;
+}
+
+// Note: the time of the RTC in the FAT on-disk format. Its date registers are BCD with a two digit year, we take it as 20xx
+static void fat16_timestamp(uint16_t* date_out, uint16_t* time_out) {
+    datetime now = rtc_get_date_time();
+    // Note: FAT years count from 1980
+    uint16_t year = fat16_from_bcd(now.year) + 20;
+    *date_out = (year << 9) | (fat16_from_bcd(now.month) << 5) | fat16_from_bcd(now.day);
+    *time_out = ((now.time.hour & 0x7F) << 11) | (now.time.minute << 5) | (now.time.second / 2);
+}
+
+// Note: marks the entry changed: the archive bit and the time of the change
+static void fat16_touch(struct fat_directory_item* item) {
+    uint16_t date = 0;
+    uint16_t time_of_day = 0;
+    fat16_timestamp(&date, &time_of_day);
+    item->attribute |= FAT_FILE_ARCHIVED;
+    item->last_mod_date = date;
+    item->last_mod_time = time_of_day;
+    item->last_access = date;
+}
+
+// Note: just frees up the space in the heap. Because we create the directory using kzalloc
+void fat16_free_directory(struct fat_directory* directory) {
+    if (!directory) {
+        return;
+    }
+
+    if (directory->item) {
+        kfree(directory->item);
+    }
+
+    if (directory->index_buckets) {
+        kfree(directory->index_buckets);
+    }
+
+    kfree(directory);
+}
+
+// Note: takes one more reference on a directory table, the root directory is never freed and needs none
+static void fat16_get_directory(struct fat_directory* directory) {
+    if (!directory->persistent) {
+        directory->refcount++;
+    }
+}
+
+// Note: drops a reference, the last one takes the table out of the volume's loaded ones and frees it
+static void fat16_put_directory(struct fat_directory* directory) {
+    if (directory->persistent || --directory->refcount > 0) {
+        return;
+    }
+
+    *directory->loaded_link = directory->next_loaded;
+    if (directory->next_loaded) {
+        directory->next_loaded->loaded_link = directory->loaded_link;
+    }
+    fat16_free_directory(directory);
+}
+
+// Note: the dentry cache calls this once it evicts a directory, items may still hold the table
+static void fat16_release_directory(void* object) {
+    struct fat_directory* directory = object;
+    directory->dentry = 0;
+    fat16_put_directory(directory);
+}
+
+// Note: Note: just frees up the space in the heap. Because we create the files using kzalloc
+// Note: a directory item drops its reference on the table, which outlives it while others hold it
+void fat16_fat_item_free(struct fat_item* item) {
+    if (item->type == FAT_ITEM_TYPE_DIRECTORY) {
+        if (item->directory) {
+            fat16_put_directory(item->directory);
+        }
+    }
+
+    else if (item->type == FAT_ITEM_TYPE_FILE) {
+        kfree(item->item);
+    }
+
+    kfree(item);
+}
+
+/* Note: This function is supposed to take a fat_directory_item that is really a directory. And then go to 
+where this file/directory is pointing to to get to the real directory, and giving us that directory as a 
+structure fat_directory */
+// Note: we are coverting fat_directory_item to fat_directory!!!
+/* Note: returns the table with a reference taken. A directory already in memory is shared rather than loaded again, so
+every open of it sees the same table, and files created or changed through one are seen through all of them */
+struct fat_directory* fat16_load_fat_directory(struct disk* disk, struct fat_directory_item* item) {
+
+    int res = 0;
+    struct fat_directory* directory = 0; // This is what we are aiming for
+    struct fat_private* fat_private = disk->fs_private; // We need the infos
+
+    // Check: if the fat_directory_item is a sub-directory (again?)
+    if (!(item->attribute & FAT_FILE_SUBDIRECTORY)) {
+        res = -EINVARG;
+        goto out;
+    }
+
+    for (directory = fat_private->loaded_directories; directory; directory = directory->next_loaded) {
+        if (directory->first_cluster == (int) fat16_get_first_cluster(item)) {
+            directory->refcount++;
+            return directory;
+        }
+    }
+
+    // Here: if it is a sub-directory
+    directory = kzalloc(sizeof(struct fat_directory));
+    // Check: if enough memory
+    if (!directory) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    // Remember: cluster address starts from 2.
+    // Remember: here the item is of directory type
+    int cluster = fat16_get_first_cluster(item); // we get cluster numebr of fat_directory here from fat_directory_item
+    directory->sector_pos = fat16_cluster_to_sector(fat_private, cluster); // Convert cluster no to sector number
+    directory->first_cluster = cluster;
+
+    // Note: a subdirectory may span several clusters, the in-memory FAT tells us how many without touching the disk
+    int total_clusters = fat16_count_clusters(disk, cluster);
+    if (total_clusters < 0)
+    {
+        res = total_clusters;
+        goto out;
+    }
+
+    int size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int directory_size = total_clusters * size_of_cluster_bytes;
+    directory->item = kzalloc(directory_size);
+    if (!directory->item)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    /* Here: we read the whole fat_directory_item of the fat_directory, which is basically a list of all the items 
+    in that directory. So bunch of entries of structure fat_directory_item.*/
+    // Note: one pass over the whole chain, contiguous clusters are read together
+    res = fat16_read_internal(disk, cluster, 0x00, directory_size, directory->item);
+    if (res != PEACHOS_ALL_OK)
+    {
+        goto out;
+    }
+
+    directory->capacity = directory_size / sizeof(struct fat_directory_item);
+    directory->total = fat16_directory_length(directory->item, directory->capacity);
+    directory->ending_sector_pos = directory->sector_pos + total_clusters * fat_private->header.primary_header.sectors_per_cluster;
+
+    fat16_build_directory_index(directory);
+
+    directory->refcount = 1;
+    directory->next_loaded = fat_private->loaded_directories;
+    directory->loaded_link = &fat_private->loaded_directories;
+    if (directory->next_loaded) {
+        directory->next_loaded->loaded_link = &directory->next_loaded;
+    }
+    fat_private->loaded_directories = directory;
+
+    out:
         if (res != PEACHOS_ALL_OK) {
             fat16_free_directory(directory);
+            directory = 0;
         } 
         return directory; 
 }
@@ -601,6 +1561,10 @@ struct fat_item* fat16_new_fat_item_for_directory_item(struct disk* disk, struct
         // Note: we put the directory in fat_item structures directory field and set the type to directory
         f_item->directory = fat16_load_fat_directory(disk, item);
         f_item->type = FAT_ITEM_TYPE_DIRECTORY;
+        if (!f_item->directory) {
+            kfree(f_item);
+            return 0;
+        }
         return f_item;
     }
 
@@ -617,61 +1581,283 @@ struct fat_item* fat16_new_fat_item_for_directory_item(struct disk* disk, struct
 
 // Note: search in the item directory table and return the fat_item
 // Note: we send the item to {fat16_new_fat_item_for_directory_item} function
+// Note: the name is converted to its 8.3 form once and looked up in the directory's name index
+static struct fat_item* fat16_scan_directory(struct disk* disk, struct fat_directory* directory, const char* name, int* found) {
+    // Here: word aligned, it is compared a word at a time
+    char raw[PEACHOS_FAT16_NAME_LENGTH] __attribute__((aligned(4)));
+    *found = 0;
+    if (fat16_name_to_raw(name, raw) < 0) {
+        return 0;
+    }
+
+    struct fat_directory_item* item = fat16_find_raw_name(directory, raw);
+    if (!item) {
+        return 0;
+    }
+
+    // Here: we create a fat item
+    // Note: we take it directly from the directory table
+    *found = 1;
+    return fat16_new_fat_item_for_directory_item(disk, item);
+}
+
+// Note: a fat_item of our own on (directory), it holds a reference on the table
+static struct fat_item* fat16_new_fat_item_for_directory(struct fat_directory* directory) {
+    struct fat_item* f_item = kzalloc(sizeof(struct fat_item));
+    if (!f_item) {
+        return 0;
+    }
+
+    f_item->type = FAT_ITEM_TYPE_DIRECTORY;
+    f_item->directory = directory;
+    fat16_get_directory(directory);
+    return f_item;
+}
+
+// Note: a fat_item for a directory the dentry cache holds, the reference (entry) carries is dropped for one on the table
+static struct fat_item* fat16_new_fat_item_for_dentry(struct dcache_entry* entry) {
+    struct fat_item* f_item = fat16_new_fat_item_for_directory(entry->object);
+    dcache_put(entry);
+    return f_item;
+}
+
+// Note: looks (name) up in (directory) through the dentry cache, a miss scans the directory table and remembers the outcome
+// Note: only directories are cached positively, they are what every path walk goes through. Files always come from the scan
+// Note: names that do not exist are cached as negative entries, so a repeated failing open does not scan again
 struct fat_item* fat16_find_item_in_directory(struct disk* disk, struct fat_directory* directory, const char* name) {
-    struct fat_item* f_item = 0;
-    char tmp_filename[PEACHOS_MAX_PATH];
-    // Check: if the file exists
-    for (int i = 0; i < directory->total; i++) {
-        fat16_get_full_relative_filename(&directory->item[i], tmp_filename, sizeof(tmp_filename));
-        if (istrncmp(tmp_filename, name, sizeof(tmp_filename)) == 0) {
-            // Here: we create a fat item
-            // Note: we take it directly from the directory table
-            f_item = fat16_new_fat_item_for_directory_item(disk, &directory->item[i]);
+    struct fat_private* fat_private = disk->fs_private;
+    // Note: the cache is keyed by the directory's address, so only directories that stay alive as long as their entries may be keys
+    int cacheable = directory == &fat_private->root_directory || directory->dentry;
+
+    if (cacheable) {
+        struct dcache_entry* entry = dcache_lookup(directory, name);
+        if (entry && !entry->object) {
+            dcache_put(entry);
+            return 0;
+        }
+
+        if (entry) {
+            return fat16_new_fat_item_for_dentry(entry);
+        }
+    }
+
+    int found = 0;
+    struct fat_item* f_item = fat16_scan_directory(disk, directory, name, &found);
+    if (!cacheable) {
+        return f_item;
+    }
+
+    if (!found) {
+        dcache_put(dcache_insert(directory, directory->dentry, name, 0, 0));
+    } else if (f_item && f_item->type == FAT_ITEM_TYPE_DIRECTORY && !f_item->directory->dentry) {
+        // Here: on success the cache holds a reference on the table of its own, the item keeps its one either way
+        struct dcache_entry* entry = dcache_insert(directory, directory->dentry, name, f_item->directory, fat16_release_directory);
+        if (entry) {
+            f_item->directory->dentry = entry;
+            fat16_get_directory(f_item->directory);
+            dcache_put(entry);
         }
     }
 
     return f_item;
 }
 
-struct fat_item* fat16_get_directory_entry(struct disk* disk, struct path_part* path) {
+// Note: walks the components of (path) from (directory), the root directory when it is 0. Each one is a view into the parsed path
+struct fat_item* fat16_get_directory_entry(struct disk* disk, struct fat_directory* directory, struct path_view* path) {
     struct fat_private* fat_private = disk->fs_private;
     struct fat_item* current_item = 0;
-    struct fat_item* root_item = fat16_find_item_in_directory(disk, &fat_private->root_directory, path->part);
-
-    // Check: if root_item exists
-    if (!root_item) {
-        goto out;
+    if (!directory) {
+        directory = &fat_private->root_directory;
     }
 
-    struct path_part* next_part = path->next;
-    current_item = root_item;
-    
-    // Check: if there is a next part to the path provided
-    while(next_part != 0) {
+    for (int i = 0; i < path->total; i++) {
         // Check: if there is a next part, then our current item must be a directory right?
-        if (current_item->type != FAT_ITEM_TYPE_DIRECTORY) {
+        if (current_item && current_item->type != FAT_ITEM_TYPE_DIRECTORY) {
+            fat16_fat_item_free(current_item);
             current_item = 0;
             break;
         }
 
-        struct fat_item* tmp_item = fat16_find_item_in_directory(disk, current_item->directory, next_part->part);
-        fat16_fat_item_free(current_item);
+        struct fat_item* tmp_item = fat16_find_item_in_directory(disk, directory, path->components[i].name);
+        if (current_item) {
+            fat16_fat_item_free(current_item);
+        }
         current_item = tmp_item;
-        next_part = next_part->next;
+        if (!current_item) {
+            break;
+        }
+        directory = current_item->directory;
     }
 
-    out:
-        return current_item;
+    return current_item;
+}
+
+// Note: the directory an open directory (from fat16_opendir) holds, 0 for no directory so walks start at the root
+static struct fat_directory* fat16_at_directory(void* at) {
+    if (!at) {
+        return 0;
+    }
+
+    return ((struct fat_file_descriptor*) at)->item->directory;
+}
+
+// Note: where slot (index) of (directory) is on disk, as a sector and the byte offset in it
+static int fat16_entry_location(struct disk* disk, struct fat_directory* directory, int index, uint32_t* sector, uint32_t* offset) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t byte = index * sizeof(struct fat_directory_item);
+    *offset = byte % disk->sector_size;
+    if (!directory->first_cluster) {
+        *sector = directory->sector_pos + byte / disk->sector_size;
+        return 0;
+    }
+
+    uint32_t size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int cluster = fat16_get_cluster_for_offset(disk, directory->first_cluster, byte);
+    if (cluster < 0) {
+        return cluster;
+    }
+
+    *sector = fat16_cluster_to_sector(private, cluster) + (byte % size_of_cluster_bytes) / disk->sector_size;
+    return 0;
+}
+
+// Note: gives a full subdirectory one more cluster of free slots, zeroed on disk before the FAT links it. The root directory can not grow
+static int fat16_grow_directory(struct disk* disk, struct fat_directory* directory) {
+    struct fat_private* private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    if (!directory->first_cluster) {
+        return -ENOMEM;
+    }
+
+    int total_clusters = fat16_count_clusters(disk, directory->first_cluster);
+    if (total_clusters < 0) {
+        return total_clusters;
+    }
+
+    int last = fat16_get_cluster_for_offset(disk, directory->first_cluster, (total_clusters - 1) * size_of_cluster_bytes);
+    if (last < 0) {
+        return last;
+    }
+
+    // Note: the new table is zeroed, its new part is what we write to the new cluster
+    struct fat_directory_item* items = kzalloc((total_clusters + 1) * size_of_cluster_bytes);
+    if (!items) {
+        return -ENOMEM;
+    }
+
+    uint32_t cluster = 0;
+    int res = fat16_allocate_clusters(disk, 0, last, 1, &cluster);
+    if (res < 0) {
+        kfree(items);
+        return res;
+    }
 
+    res = disk_write_block(disk, fat16_cluster_to_sector(private, cluster), private->header.primary_header.sectors_per_cluster, (void*) items + total_clusters * size_of_cluster_bytes);
+    if (res >= 0) {
+        res = fat16_sync_fat_table(disk, fat16_write_fat_sector);
+    }
+
+    if (res < 0) {
+        fat16_set_fat_entry(disk, last, PEACHOS_FAT16_CHAIN_END);
+        fat16_free_chain(disk, cluster);
+        kfree(items);
+        return res;
+    }
+
+    memcpy(items, directory->item, directory->capacity * sizeof(struct fat_directory_item));
+    kfree(directory->item);
+    directory->item = items;
+    directory->capacity = (total_clusters + 1) * size_of_cluster_bytes / sizeof(struct fat_directory_item);
+    directory->ending_sector_pos += private->header.primary_header.sectors_per_cluster;
+    return 0;
+}
+
+/* Note: creates the empty file (name) in (directory). Its entry goes to the first deleted or unused slot, on disk and in
+the table, and a negative dcache entry of the name goes away. Returns the file's fat_item, or an ERROR() pointer */
+static struct fat_item* fat16_create_file(struct disk* disk, struct fat_directory* directory, const char* name) {
+    char raw[PEACHOS_FAT16_NAME_LENGTH] __attribute__((aligned(4)));
+    if (fat16_name_to_raw(name, raw) < 0 || raw[0] == '.') {
+        return ERROR(-EBADPATH);
+    }
+
+    int index = 0;
+    while (index < directory->total && directory->item[index].filename[0] != PEACHOS_FAT16_DELETED_ENTRY) {
+        index++;
+    }
+
+    int res = 0;
+    if (index == directory->capacity) {
+        res = fat16_grow_directory(disk, directory);
+        if (res < 0) {
+            return ERROR(res);
+        }
+    }
+
+    struct fat_directory_item item;
+    memset(&item, 0, sizeof(item));
+    memcpy(item.filename, raw, PEACHOS_FAT16_NAME_LENGTH);
+    fat16_touch(&item);
+    item.creation_date = item.last_mod_date;
+    item.creation_time = item.last_mod_time;
+
+    uint32_t sector = 0;
+    uint32_t offset = 0;
+    res = fat16_entry_location(disk, directory, index, &sector, &offset);
+    if (res >= 0) {
+        res = fat16_write_partial_sector(disk, sector, offset, &item, sizeof(item), 0);
+    }
+    if (res < 0) {
+        return ERROR(res);
+    }
+
+    // Here: the table and its name index take the new entry
+    directory->item[index] = item;
+    if (index == directory->total) {
+        directory->total++;
+    }
+    if (directory->index_buckets) {
+        kfree(directory->index_buckets);
+        directory->index_buckets = 0;
+    }
+    fat16_build_directory_index(directory);
+    dcache_invalidate(directory, name);
+
+    struct fat_item* f_item = fat16_new_fat_item_for_directory_item(disk, &directory->item[index]);
+    return f_item ? f_item : ERROR(-ENOMEM);
+}
+
+/* Note: makes a change of the file durable, the FAT (every copy of it) and the file's entry. A file that grew has its
+FAT written first and one that was cut its entry, so a crash in between can lose clusters but never give one to two
+files. The parent's table in memory gets the entry too, later opens and listings see it */
+static int fat16_commit(struct disk* disk, struct fat_file_descriptor* descriptor, int cut) {
+    struct fat_directory_item* item = descriptor->item->item;
+    int res = 0;
+    for (int step = 0; step < 2 && res >= 0; step++) {
+        if (step == (cut ? 1 : 0)) {
+            res = fat16_sync_fat_table(disk, fat16_write_fat_sector);
+        } else {
+            res = fat16_write_partial_sector(disk, descriptor->entry_sector, descriptor->entry_offset, item, sizeof(struct fat_directory_item), 0);
+        }
+    }
+
+    if (res < 0) {
+        return res;
+    }
+
+    descriptor->parent->directory->item[descriptor->entry_index] = *item;
+    return 0;
 }
 
-// Note: creates a fat_file_descriptor 
-void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
+/* Note: creates a fat_file_descriptor. Opening for writing or appending creates a file that does not exist yet, in a
+directory that does. Every open file holds its directory, so its entry can be written back when the file changes */
+void* fat16_open(struct disk* disk, void* at, struct path_view* path, FILE_MODE mode)
 {   
+    struct fat_private* fat_private = disk->fs_private;
     struct fat_file_descriptor* descriptor = 0;
+    struct fat_item* walked = 0;
     int err_code = 0;
-    // Check: mode should only be READ for now
-    if (mode != FILE_MODE_READ) {
+    // Check: only a disk we can write takes files opened for writing
+    if (mode != FILE_MODE_READ && disk_is_read_only(disk)) {
         err_code = -ERDONLY;
         goto err_out;
     }
@@ -683,18 +1869,83 @@ void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
         goto err_out;
     }
 
-    // Note: Get the item from the disk by path
-    descriptor->item = fat16_get_directory_entry(disk, path);
+    // Note: the directory is walked from the open directory (at) when we have one, the file is looked up in it
+    struct fat_directory* directory = fat16_at_directory(at);
+    if (!directory) {
+        directory = &fat_private->root_directory;
+    }
+    if (path->total > 1) {
+        // Here: the walk stops one component short
+        path->total--;
+        walked = fat16_get_directory_entry(disk, directory, path);
+        path->total++;
+        if (!walked || walked->type != FAT_ITEM_TYPE_DIRECTORY) {
+            err_code = -EIO;
+            goto err_out;
+        }
+        directory = walked->directory;
+    }
+
+    const char* name = path->components[path->total - 1].name;
+    descriptor->item = fat16_find_item_in_directory(disk, directory, name);
+    if (!descriptor->item && mode != FILE_MODE_READ) {
+        descriptor->item = fat16_create_file(disk, directory, name);
+        if (ISERR(descriptor->item)) {
+            err_code = ERROR_I(descriptor->item);
+            descriptor->item = 0;
+            goto err_out;
+        }
+        descriptor->modified = 1;
+    }
+
     if (!descriptor->item) {
         err_code = -EIO;
         goto err_out;
     }
 
-    descriptor->pos = 0; // the file will start to be read from beginning thus position is 0
+    // Check: directories are opened with opendir, and read only files are never written
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE) {
+        err_code = -EINVARG;
+        goto err_out;
+    }
+    if (mode != FILE_MODE_READ && (descriptor->item->item->attribute & FAT_FILE_READ_ONLY)) {
+        err_code = -ERDONLY;
+        goto err_out;
+    }
+
+    // Here: the entry's slot in the table tells us where it is on disk
+    struct fat_directory_item* slot = fat16_find_raw_name(directory, (const char*) descriptor->item->item->filename);
+    if (!slot) {
+        err_code = -EIO;
+        goto err_out;
+    }
+
+    descriptor->entry_index = slot - directory->item;
+    err_code = fat16_entry_location(disk, directory, descriptor->entry_index, &descriptor->entry_sector, &descriptor->entry_offset);
+    if (err_code < 0) {
+        goto err_out;
+    }
+
+    descriptor->parent = walked ? walked : fat16_new_fat_item_for_directory(directory);
+    walked = 0;
+    if (!descriptor->parent) {
+        err_code = -ENOMEM;
+        goto err_out;
+    }
 
+    descriptor->disk = disk;
     return descriptor;
 
     err_out:
+        if (walked) {
+            fat16_fat_item_free(walked);
+        }
+        if (descriptor && descriptor->item) {
+            fat16_fat_item_free(descriptor->item);
+        }
+        if (descriptor && descriptor->parent) {
+            fat16_fat_item_free(descriptor->parent);
+        }
         if (descriptor) {
             kfree(descriptor);
         }
@@ -704,13 +1955,33 @@ void* fat16_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
 // Note: closes a file given the fat_file_descriptor
 static void fat16_free_file_descriptor(struct fat_file_descriptor* desc)
 {
+    if (desc->extents)
+    {
+        kfree(desc->extents);
+    }
+    if (desc->parent)
+    {
+        fat16_fat_item_free(desc->parent);
+    }
     fat16_fat_item_free(desc->item);
     kfree(desc);
 }
 
 // Note: closes a file given the fat_file_descriptor, by calling {fat16_free_file_descriptor}
+/* Note: the last close of a written file is where it is made durable. Clusters fallocate reserved past its end go back,
+its entry gets the time of the change and the disk is flushed, so what was written survives a power loss from here on */
 int fat16_close(void* private) {
-    fat16_free_file_descriptor((struct fat_file_descriptor*) private);
+    struct fat_file_descriptor* descriptor = private;
+    struct disk* disk = descriptor->disk;
+    int cut = descriptor->preallocated && fat16_trim_chain(disk, descriptor, descriptor->item->item->filesize) >= 0;
+    if (descriptor->modified || cut) {
+        fat16_touch(descriptor->item->item);
+        if (fat16_commit(disk, descriptor, cut) >= 0) {
+            disk_flush(disk);
+        }
+    }
+
+    fat16_free_file_descriptor(descriptor);
     return 0;
 }
 
@@ -737,60 +2008,271 @@ int fat16_stat(struct disk* disk, void* private, struct file_stat* stat) {
         return res;
 }
 
-// Note: reads the file contents into the out_ptr
-int fat16_read(struct disk* disk, void* descriptor, uint32_t size, uint32_t nmemb, char* out_ptr) {
-    int res = 0;
-    struct fat_file_descriptor* fat_desc = descriptor;
-    struct fat_directory_item* item = fat_desc->item->item;
-    int offset = fat_desc->pos;
+// Note: reads (total) bytes from (offset) of an open file, the VFS keeps the read inside the file and caches it
+int fat16_read_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, char* out) {
+    struct fat_file_descriptor* fat_desc = private;
+    if (fat_desc->item->type != FAT_ITEM_TYPE_FILE) {
+        return -EINVARG;
+    }
 
-    for (uint32_t i = 0; i < nmemb; i++) {
-        res = fat16_read_internal(disk, fat16_get_first_cluster(item), offset, size, out_ptr);
-        if (ISERR(res)) {
-            goto out;
+    return fat16_read_extents(disk, fat_desc, offset, total, out);
+}
+
+// Note: only files are written, and only on a disk we can write
+static int fat16_check_writable(struct disk* disk, struct fat_file_descriptor* descriptor) {
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE) {
+        return -EINVARG;
+    }
+    if (disk_is_read_only(disk)) {
+        return -ERDONLY;
+    }
+    return 0;
+}
+
+/* Note: writes (total) bytes at (offset) of an open file, the VFS writes inside the file or right at its end. The chain
+grows first (on from its last cluster when that is free), then the data goes out. The FAT and the entry are only written
+when the chain or the size changed, the time of the change waits for close. Fewer bytes are written when the volume
+runs out of clusters */
+int fat16_write_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, const char* in) {
+    struct fat_file_descriptor* descriptor = private;
+    struct fat_private* fat_private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int res = fat16_check_writable(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    // Check: the file has no holes and stays below 4 GiB
+    struct fat_directory_item* item = descriptor->item->item;
+    if (offset > item->filesize) {
+        return -EINVARG;
+    }
+    if (total > 0xFFFFFFFF - offset) {
+        total = 0xFFFFFFFF - offset;
+    }
+
+    res = fat16_load_extents(disk, descriptor);
+    if (res >= 0) {
+        res = fat16_load_cluster_map(disk);
+    }
+    if (res < 0) {
+        return res;
+    }
+
+    // Here: we write what the file's clusters and the free ones can hold
+    uint64_t room = (uint64_t) (fat16_chain_clusters(descriptor) + fat_private->free_clusters) * size_of_cluster_bytes;
+    if ((uint64_t) offset + total > room) {
+        total = room > offset ? room - offset : 0;
+        if (total == 0) {
+            return -ENOMEM;
         }
-        out_ptr += size;
-        offset += size;
     }
 
-    res = nmemb; // Because response should be the total amount read
-    out:
+    uint32_t end = offset + total;
+    uint32_t first_cluster = fat16_get_first_cluster(item);
+    res = fat16_reserve_clusters(disk, descriptor, end / size_of_cluster_bytes + (end % size_of_cluster_bytes != 0));
+    if (res >= 0) {
+        res = fat16_write_extents(disk, descriptor, offset, total, in);
+    }
+    descriptor->modified = 1;
+
+    // Note: an overwrite inside the file changes no metadata, the FAT and the entry stay as they are on disk
+    int grew = fat16_get_first_cluster(item) != first_cluster || fat16_fat_dirty(disk);
+    if (res >= 0 && end > item->filesize) {
+        item->filesize = end;
+        grew = 1;
+    }
+    if (!grew) {
+        return res < 0 ? res : (int) total;
+    }
+
+    // Note: the FAT and the entry go out even when the data did not, so clusters we took are never lost
+    int commit_res = fat16_commit(disk, descriptor, 0);
+    if (res < 0) {
         return res;
+    }
+    if (commit_res < 0) {
+        return commit_res;
+    }
+    return total;
 }
 
-// Note: decide where to put the pointer, to read or write to the file 
-int fat16_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode) {
+// Note: grows the file to (size) bytes with zeros, a cluster at a time
+static int fat16_zero_fill(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t size) {
+    struct fat_private* fat_private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    struct fat_directory_item* item = descriptor->item->item;
+    char* zeros = kzalloc(size_of_cluster_bytes);
+    if (!zeros) {
+        return -ENOMEM;
+    }
+
     int res = 0;
-    struct fat_file_descriptor* desc = private;
-    struct fat_item* desc_item = desc->item;
+    while (res >= 0 && item->filesize < size) {
+        uint32_t chunk = size - item->filesize;
+        if (chunk > size_of_cluster_bytes) {
+            chunk = size_of_cluster_bytes;
+        }
+        res = fat16_write_at(disk, descriptor, item->filesize, chunk, zeros);
+    }
 
-    // Check: if it is a file or directory
-    if (desc_item->type != FAT_ITEM_TYPE_FILE) {
-        res = -EINVARG;
-        goto out;
+    kfree(zeros);
+    return res < 0 ? res : 0;
+}
+
+// Note: cuts the file to (size) bytes and gives back the clusters it no longer needs (reserved ones too), or grows it with zeros
+int fat16_truncate(struct disk* disk, void* private, uint32_t size) {
+    struct fat_file_descriptor* descriptor = private;
+    int res = fat16_check_writable(disk, descriptor);
+    if (res < 0) {
+        return res;
     }
 
-    struct fat_directory_item* ritem = desc_item->item;
-    // Check: if offset is valid
-    if (offset >= ritem->filesize) {
-        res = -EIO;
-        goto out;
+    struct fat_directory_item* item = descriptor->item->item;
+    if (size > item->filesize) {
+        return fat16_zero_fill(disk, descriptor, size);
     }
 
-    switch(seek_mode) {
-        case SEEK_SET:
-            desc->pos = offset;
-            break;
-        case SEEK_END:
-            res = -EUNIMP;
-            break;
-        case SEEK_CUR:
-            desc->pos += offset;
-            break;
-        default:
-            res = -EINVARG;
-            break;
+    descriptor->modified = 1;
+    if (size == item->filesize && !descriptor->preallocated) {
+        return 0;
     }
-    out:
+
+    res = fat16_trim_chain(disk, descriptor, size);
+    if (res < 0) {
+        return res;
+    }
+
+    item->filesize = size;
+    return fat16_commit(disk, descriptor, 1);
+}
+
+/* Note: reserves the clusters (offset + length) bytes of the file need without changing its size, in a single run where
+the free space allows. The writes that fill them go out as long sequential writes and read back the same way. Clusters
+still past the end of the file when it is closed are given back then */
+int fat16_fallocate(struct disk* disk, void* private, uint32_t offset, uint32_t length) {
+    struct fat_file_descriptor* descriptor = private;
+    struct fat_private* fat_private = disk->fs_private;
+    uint32_t size_of_cluster_bytes = fat_private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    int res = fat16_check_writable(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+    if (length > 0xFFFFFFFF - offset) {
+        return -EINVARG;
+    }
+
+    res = fat16_load_extents(disk, descriptor);
+    if (res < 0) {
+        return res;
+    }
+
+    uint32_t end = offset + length;
+    uint32_t clusters = end / size_of_cluster_bytes + (end % size_of_cluster_bytes != 0);
+    if (clusters <= fat16_chain_clusters(descriptor)) {
+        return 0;
+    }
+
+    res = fat16_reserve_clusters(disk, descriptor, clusters);
+    if (res < 0) {
         return res;
-}
\ No newline at end of file
+    }
+
+    descriptor->preallocated = 1;
+    descriptor->modified = 1;
+    return fat16_commit(disk, descriptor, 0);
+}
+
+// Note: a file is told apart by the place of its entry on disk, which stays the same while the file grows, shrinks or is emptied
+uint32_t fat16_ino(struct disk* disk, void* private) {
+    struct fat_file_descriptor* fat_desc = private;
+    if (fat_desc->item->type != FAT_ITEM_TYPE_FILE) {
+        return 0;
+    }
+
+    int entries_per_sector = disk->sector_size / sizeof(struct fat_directory_item);
+    return fat_desc->entry_sector * entries_per_sector + fat_desc->entry_offset / sizeof(struct fat_directory_item);
+}
+
+// Note: opens a directory for listing, the descriptor's pos is the index of the next entry
+void* fat16_opendir(struct disk* disk, void* at, struct path_view* path) {
+    struct fat_private* fat_private = disk->fs_private;
+    int err_code = 0;
+    struct fat_file_descriptor* descriptor = kzalloc(sizeof(struct fat_file_descriptor));
+    if (!descriptor) {
+        err_code = -ENOMEM;
+        goto err_out;
+    }
+
+    // Note: the root directory has no entry of its own, we hand out the one fat_private keeps
+    if (path->total == 0) {
+        descriptor->item = kzalloc(sizeof(struct fat_item));
+        if (!descriptor->item) {
+            err_code = -ENOMEM;
+            goto err_out;
+        }
+        descriptor->item->type = FAT_ITEM_TYPE_DIRECTORY;
+        descriptor->item->directory = &fat_private->root_directory;
+        return descriptor;
+    }
+
+    descriptor->item = fat16_get_directory_entry(disk, fat16_at_directory(at), path);
+    if (!descriptor->item) {
+        err_code = -EIO;
+        goto err_out;
+    }
+
+    // Check: only directories can be listed
+    if (descriptor->item->type != FAT_ITEM_TYPE_DIRECTORY) {
+        err_code = -EINVARG;
+        goto err_out;
+    }
+
+    return descriptor;
+
+    err_out:
+        if (descriptor && descriptor->item) {
+            fat16_fat_item_free(descriptor->item);
+        }
+        if (descriptor) {
+            kfree(descriptor);
+        }
+        return ERROR(err_code);
+}
+
+// Note: fills up to (max) entries of the directory, deleted slots, long file name parts and the volume label are skipped
+int fat16_readdir(struct disk* disk, void* private, struct file_dirent* out, int max) {
+    struct fat_file_descriptor* descriptor = private;
+    if (descriptor->item->type != FAT_ITEM_TYPE_DIRECTORY) {
+        return -EINVARG;
+    }
+
+    struct fat_directory* directory = descriptor->item->directory;
+    int total = 0;
+    while (total < max && descriptor->pos < directory->total) {
+        struct fat_directory_item* item = &directory->item[descriptor->pos++];
+        if (!fat16_is_lookup_entry(item)) {
+            continue;
+        }
+
+        struct file_dirent* dirent = &out[total++];
+        memset(dirent, 0, sizeof(struct file_dirent));
+        fat16_get_full_relative_filename(item, dirent->name, sizeof(dirent->name));
+        dirent->size = item->filesize;
+        dirent->creation_date = item->creation_date;
+        dirent->creation_time = item->creation_time;
+        dirent->last_mod_date = item->last_mod_date;
+        dirent->last_mod_time = item->last_mod_time;
+        if (item->attribute & FAT_FILE_SUBDIRECTORY) {
+            dirent->flags |= FILE_DIRENT_DIRECTORY;
+        }
+        if (item->attribute & FAT_FILE_READ_ONLY) {
+            dirent->flags |= FILE_DIRENT_READ_ONLY;
+        }
+        if (item->attribute & FAT_FILE_HIDDEN) {
+            dirent->flags |= FILE_DIRENT_HIDDEN;
+        }
+    }
+
+    return total;
+}
@@ -3,6 +3,8 @@
 #include "memory/memory.h"
 #include "memory/heap/kheap.h"
 #include "fat/fat16.h"
+#include "tmpfs/tmpfs.h"
+#include "vfs.h"
 #include "status.h"
 #include "kernel.h"
 #include "disk/disk.h"
@@ -10,9 +12,9 @@
 
 struct filesystem* filesystems[PEACHOS_MAX_FILESYSTEMS];
 
-/* this is basically the file descriptor table. It contains bunch of addresses(pointers) that points to all the
-different file descriptors available. And there are 512 addresses in this table */
-struct file_descriptor* file_descriptors[PEACHOS_MAX_FILE_DESCRIPTORS];
+/* this is basically the kernel's own file descriptor table, used by fopen and friends (e.g. the program loaders).
+Processes have their own table in struct process */
+static struct file_table kernel_files;
 
 static struct filesystem** fs_get_free_filesystem()
 {
@@ -45,6 +47,7 @@ void fs_insert_filesystem(struct filesystem* filesystem)
 static void fs_static_load()
 {
     fs_insert_filesystem(fat16_init());
+    fs_insert_filesystem(tmpfs_init());
 }
 
 void fs_load()
@@ -55,51 +58,102 @@ void fs_load()
 
 void fs_init()
 {
-    memset(file_descriptors, 0, sizeof(file_descriptors));
+    file_table_init(&kernel_files);
     fs_load();
 }
 
-// Note: fress the descriptor from the table and sets that slot to 0 to indicate that its an empty slot
-static void file_free_descriptor(struct file_descriptor* desc)
+// Note: every slot is free, chained in order so the lowest descriptors are handed out first
+void file_table_init(struct file_table* table)
 {
-    file_descriptors[desc->index-1] = 0x00;
-    kfree(desc);
-};
+    memset(table->files, 0, sizeof(table->files));
+    for (int i = 0; i < PEACHOS_MAX_FILE_DESCRIPTORS - 1; i++)
+    {
+        table->next_free[i] = i + 1;
+    }
+    table->next_free[PEACHOS_MAX_FILE_DESCRIPTORS - 1] = -1;
+    table->free_head = 0;
+}
+
+// Note: puts the open file in a free slot of the table, the slot takes over the caller's reference
+// Note: returns the descriptor (the slot index + 1, descriptors start at 1)
+int file_table_install(struct file_table* table, struct file_descriptor* desc)
+{
+    int i = table->free_head;
+    if (i < 0)
+    {
+        return -EISTKN;
+    }
+
+    table->free_head = table->next_free[i];
+    table->files[i] = desc;
+    return i + 1;
+}
 
-// Note: this will find a slot in the descriptor table and return to us the index
-static int file_new_descriptor(struct file_descriptor** desc_out)
+// Note: this will get us the open file, given the descriptor
+struct file_descriptor* file_table_get(struct file_table* table, int fd)
 {
-    int res = -ENOMEM;
-    for (int i = 0; i < PEACHOS_MAX_FILE_DESCRIPTORS; i++)
+    if (fd <= 0 || fd > PEACHOS_MAX_FILE_DESCRIPTORS)
     {
-        // go through the file descriptor table and look for free slots. where the address is 0 basically
-        if (file_descriptors[i] == 0)  
+        return 0;
+    }
+
+    // Descriptors start at 1
+    return table->files[fd - 1];
+}
+
+// Note: frees the slot and drops its reference on the open file
+int file_table_close(struct file_table* table, int fd)
+{
+    struct file_descriptor* desc = file_table_get(table, fd);
+    if (!desc)
+    {
+        return -EIO;
+    }
+
+    int i = fd - 1;
+    table->files[i] = 0x00;
+    table->next_free[i] = table->free_head;
+    table->free_head = i;
+    return file_put(desc);
+}
+
+// Note: closes whatever is still open, e.g. when a process exits
+void file_table_close_all(struct file_table* table)
+{
+    for (int fd = 1; fd <= PEACHOS_MAX_FILE_DESCRIPTORS; fd++)
+    {
+        if (table->files[fd - 1])
         {
-            struct file_descriptor* desc = kzalloc(sizeof(struct file_descriptor));
-            // Descriptors start at 1. So we adjust it by adding one to the result
-            desc->index = i + 1;
-            file_descriptors[i] = desc; // we save our created descriptor in the FDT
-            *desc_out = desc; // and then we send the descriptor to the callers desc_out space
-            res = 0;
-            break;
+            file_table_close(table, fd);
         }
     }
-
-    return res;
 }
 
+void file_get(struct file_descriptor* desc)
+{
+    desc->refcount++;
+}
 
-// Note: this will get us the whole descriptor, given the index in the file descriptor table
-static struct file_descriptor* file_get_descriptor(int fd)
+// Note: drops a reference, the last one closes the file in its filesystem
+int file_put(struct file_descriptor* desc)
 {
-    if (fd <= 0 || fd >= PEACHOS_MAX_FILE_DESCRIPTORS)
+    int res = 0;
+    desc->refcount--;
+    if (desc->refcount > 0)
     {
         return 0;
     }
 
-    // Descriptors start at 1
-    int index = fd - 1;
-    return file_descriptors[index];
+    if (desc->type == FILE_TYPE_FILE)
+    {
+        vfs_inode_put(desc->inode);
+    }
+    else
+    {
+        res = desc->mount->filesystem->close(desc->private);
+    }
+    kfree(desc);
+    return res;
 }
 
 // Note: it resolves the filesystem by looking into the disk. And then sets the filesystem field of the disk struct
@@ -132,140 +186,404 @@ FILE_MODE file_get_mode_by_string(const char* str) {
     return mode;
 }
 
-// Note: if successful, returns an index in the file_descriptor table, otherwise returns 0
-int fopen(const char* filename, const char* mode_str)
+/* Note: parses (path_str) into (path) and finds where the filesystem walks it from: the mount, and the open directory
+of that mount to start at (*start, 0 for the root). Relative paths start at the open directory (at), so the components
+above it are not walked again */
+// Note: a relative path that climbs above (at) or names (at) itself is joined to at's path and walked from the root
+static int file_resolve_path(struct file_descriptor* at, const char* path_str, struct path_view* path, struct vfs_mount** mount, void** start)
+{
+    *start = 0;
+    if (pathparser_parse(path_str, path) < 0) {
+        return -EINVARG;
+    }
+
+    if (path->relative) {
+        // Check: a relative path needs a directory to start from
+        if (!at || at->type != FILE_TYPE_DIRECTORY) {
+            return -EBADPATH;
+        }
+
+        if (path->up == 0 && path->total > 0) {
+            path->drive_no = at->mount->drive_no;
+            *mount = at->mount;
+            *start = at->private;
+            return 0;
+        }
+
+        // Here: parsing the joined path again resolves the leading ".." against at's own components
+        char absolute[PEACHOS_MAX_PATH];
+        int len = strlen(at->path);
+        if (len + 1 + strlen(path_str) >= PEACHOS_MAX_PATH) {
+            return -EBADPATH;
+        }
+        strcpy(absolute, at->path);
+        absolute[len] = '/';
+        strcpy(&absolute[len + 1], path_str);
+        if (pathparser_parse(absolute, path) < 0) {
+            return -EBADPATH;
+        }
+    }
+
+    // Check: if something is mounted at the drive
+    *mount = vfs_get_mount(path->drive_no);
+    if (!*mount) {
+        return -EIO;
+    }
+    return 0;
+}
+
+// Note: opens a file and returns the open file with one reference, or an ERROR() pointer
+struct file_descriptor* file_open(const char* filename, const char* mode_str)
+{
+    return file_open_at(0, filename, mode_str);
+}
+
+// Note: like file_open, a relative (filename) is looked up from the open directory (at)
+struct file_descriptor* file_open_at(struct file_descriptor* at, const char* filename, const char* mode_str)
 {
     int res = 0;
+    struct file_descriptor* desc = 0;
 
     // Check: if path is in valid format
-    struct path_root* root_path = pathparser_parse(filename, NULL);
-    if (!root_path) { // root_path didn't return a pointer to heap
-        res = -EINVARG;
+    // Note: the parsed path lives on our stack, opening a file does not touch the heap for it
+    struct path_view path;
+    struct vfs_mount* mount = 0;
+    void* start = 0;
+    res = file_resolve_path(at, filename, &path, &mount, &start);
+    if (res < 0) {
         goto out;
     }
-    if (!root_path->first) { // doesn't have anything after the drive no.
+    if (path.total == 0) { // doesn't have anything after the drive no.
         res = -EINVARG;
         goto out;
     }
 
-    // Check: if the disk exists
-    struct disk* disk = disk_get(root_path->drive_no);
-    if (!disk) {
-        res = -EIO;
+    // Check: if mode is valid
+    FILE_MODE mode = file_get_mode_by_string(mode_str);
+    if (mode == FILE_MODE_INVALID) {
+        res = -EINVARG;
         goto out;
     }
-    if (!disk->filesystem) {
-        res = -EIO;
+
+    // Check: only filesystems that can write open files for writing
+    if (mode != FILE_MODE_READ && !mount->filesystem->write_at) {
+        res = -ERDONLY;
         goto out;
     }
 
-    // Check: if mode is valid
-    FILE_MODE mode = file_get_mode_by_string(mode_str);
-    if (mode == FILE_MODE_INVALID) {
-        res = -EINVARG;
+    // Here: we create the open file
+    desc = kzalloc(sizeof(struct file_descriptor));
+    if (!desc) {
+        res = -ENOMEM;
         goto out;
     }
 
     /* Note: we call the filesystems open function, and in return get a pointer to a descriptor (which exists somewhere
     on the heap, e.g. in fat16_open function we create a descriptor (=kzalloc(sizeof(struct fat_file_descriptor))) */
-    void* descriptor_private_data = disk->filesystem->open(disk, root_path->first, mode);
+    void* descriptor_private_data = mount->filesystem->open(mount->disk, start, &path, mode);
     if (ISERR(descriptor_private_data)) {
         res = ERROR_I(descriptor_private_data);
         goto out;
     }
-    // Here: we create the descriptor
-    struct file_descriptor* desc = 0;
-    // Here: we give it the descriptor and get an index in the table
-    res = file_new_descriptor(&desc);
-    if (res < 0) {
+
+    // Here: the inode takes the filesystem's descriptor, or closes it if the file is open already and shares that one
+    struct vfs_inode* inode = vfs_inode_get(mount, descriptor_private_data);
+    if (ISERR(inode)) {
+        res = ERROR_I(inode);
         goto out;
     }
-    desc->filesystem = disk->filesystem;
-    desc->private = descriptor_private_data;
-    desc->disk = disk;
-    res = desc->index; // index is set when we called file_new_descriptor() function
+
+    desc->refcount = 1;
+    desc->type = FILE_TYPE_FILE;
+    desc->mount = mount;
+    desc->inode = inode;
+    desc->pos = 0;
+    desc->mode = mode;
+
+    // Note: opening for writing starts the file over, like fopen's "w"
+    if (mode == FILE_MODE_WRITE) {
+        res = vfs_truncate(inode, 0);
+        if (res < 0) {
+            vfs_inode_put(inode);
+            goto out;
+        }
+    }
 
     out:
-    if(res < 0) {
-        res = 0; // fopen shouldn't return negative values
+    if (res < 0) {
+        if (desc) {
+            kfree(desc);
+        }
+        return ERROR(res);
     }
-        return res;
+        return desc;
 }
 
-// Note: gets info on a file given descriptor index
-int fstat(int fd, struct file_stat* stat) {
+// Note: opens a directory to list it, "0:/" is the root directory. Returns the open directory or an ERROR() pointer
+struct file_descriptor* file_opendir(const char* path_str)
+{
+    return file_opendir_at(0, path_str);
+}
+
+// Note: like file_opendir, a relative path is looked up from the open directory (at). The result can be an (at) itself,
+// e.g. a process's current directory
+struct file_descriptor* file_opendir_at(struct file_descriptor* at, const char* path_str)
+{
     int res = 0;
-    struct file_descriptor* desc = file_get_descriptor(fd);
-    // Check: if the descriptor exists in the table
+    struct file_descriptor* desc = 0;
+
+    struct path_view path;
+    struct vfs_mount* mount = 0;
+    void* start = 0;
+    res = file_resolve_path(at, path_str, &path, &mount, &start);
+    if (res < 0) {
+        goto out;
+    }
+
+    // Check: the filesystem must know how to list its directories
+    if (!mount->filesystem->opendir || !mount->filesystem->readdir) {
+        res = -EUNIMP;
+        goto out;
+    }
+
+    desc = kzalloc(sizeof(struct file_descriptor));
     if (!desc) {
-        res = -EIO;
+        res = -ENOMEM;
         goto out;
     }
 
-    res = desc->filesystem->stat(desc->disk, desc->private, stat);
+    // Here: the directory remembers where it is, "0:/" and the components walked from there
+    char root[] = "0:/";
+    root[0] += mount->drive_no;
+    res = pathparser_format(start ? at->path : root, &path, desc->path);
+    if (res < 0) {
+        goto out;
+    }
+
+    void* descriptor_private_data = mount->filesystem->opendir(mount->disk, start, &path);
+    if (ISERR(descriptor_private_data)) {
+        res = ERROR_I(descriptor_private_data);
+        goto out;
+    }
+
+    desc->refcount = 1;
+    desc->type = FILE_TYPE_DIRECTORY;
+    desc->mount = mount;
+    desc->private = descriptor_private_data;
 
     out:
+    if (res < 0) {
+        if (desc) {
+            kfree(desc);
+        }
+        return ERROR(res);
+    }
+        return desc;
+}
+
+// Note: the next (max) entries of an open directory, returns how many were filled in and 0 once the listing is done
+int file_readdir(struct file_descriptor* desc, struct file_dirent* out, int max) {
+    if (desc->type != FILE_TYPE_DIRECTORY || max <= 0) {
+        return -EINVARG;
+    }
+
+    return desc->mount->filesystem->readdir(desc->mount->disk, desc->private, out, max);
+}
+
+// Note: creates the directory (path), e.g. "9:/scratch"
+int file_mkdir(const char* path_str) {
+    return file_mkdir_at(0, path_str);
+}
+
+// Note: like file_mkdir, a relative path is looked up from the open directory (at)
+int file_mkdir_at(struct file_descriptor* at, const char* path_str) {
+    struct path_view path;
+    struct vfs_mount* mount = 0;
+    void* start = 0;
+    int res = file_resolve_path(at, path_str, &path, &mount, &start);
+    if (res < 0) {
         return res;
+    }
+    if (!mount->filesystem->mkdir) {
+        return -EUNIMP;
+    }
+
+    return mount->filesystem->mkdir(mount->disk, start, &path);
 }
 
-// Note: take file descriptor index and removes it from descriptor table
-int fclose(int fd) {
+// Note: gets info on an open file, straight from its inode
+int file_stat(struct file_descriptor* desc, struct file_stat* stat) {
+    if (desc->type != FILE_TYPE_FILE) {
+        return -EINVARG;
+    }
+
+    stat->flags = desc->inode->flags;
+    stat->filesize = desc->inode->size;
+    return 0;
+}
+
+// Note: decide where to put the pointer, to read or write to the file
+int file_seek(struct file_descriptor* desc, int offset, FILE_SEEK_MODE whence) {
+    // Check: if it is a file and the offset is inside it
+    if (desc->type != FILE_TYPE_FILE) {
+        return -EINVARG;
+    }
+    if ((uint32_t) offset >= desc->inode->size) {
+        return -EIO;
+    }
+
     int res = 0;
-    struct file_descriptor* desc = file_get_descriptor(fd);
-    
-    // Check: if descriptor exists in the table
-    if(!desc) {
-        res = -EIO;
-        goto out;
+    switch(whence) {
+        case SEEK_SET:
+            desc->pos = offset;
+            break;
+        case SEEK_END:
+            res = -EUNIMP;
+            break;
+        case SEEK_CUR:
+            desc->pos += offset;
+            break;
+        default:
+            res = -EINVARG;
+            break;
+    }
+    return res;
+}
+
+// Note: reserves room for (offset + length) bytes of a file open for writing, so the writes that fill it are laid out in one run
+int file_fallocate(struct file_descriptor* desc, uint32_t offset, uint32_t length) {
+    if (desc->type != FILE_TYPE_FILE) {
+        return -EINVARG;
+    }
+    if (desc->mode == FILE_MODE_READ) {
+        return -ERDONLY;
     }
 
-    res = desc->filesystem->close(desc->private);
-    // Check: if filesystems close is able to remove the descriptor from memory
-    // Note: then we remove it from the file descriptor table in memory
-    if (res == PEACHOS_ALL_OK) {
-        file_free_descriptor(desc);
+    return vfs_fallocate(desc->inode, offset, length);
+}
+
+// Note: page (index) of the open file, pinned in the page cache until pagecache_put. 0 if it can not be cached
+struct pagecache_page* file_get_page(struct file_descriptor* desc, uint32_t index) {
+    if (desc->type != FILE_TYPE_FILE) {
+        return 0;
     }
-    out: 
+
+    return vfs_get_page(desc->inode, index);
+}
+
+// Note: reads up to nmemb elements of size bytes from the current position, with one read for all of them
+// Note: like fread only whole elements are read, the return value is how many, and the position moves past them
+int file_read(struct file_descriptor* desc, void* ptr, uint32_t size, uint32_t nmemb) {
+    // Check: if arguments are valid
+    if (size == 0 || nmemb == 0 || desc->type != FILE_TYPE_FILE) {
+        return -EINVARG;
+    }
+
+    // Check: we never read past the end of the file
+    struct vfs_inode* inode = desc->inode;
+    uint32_t left = desc->pos < inode->size ? inode->size - desc->pos : 0;
+    uint32_t total_elements = nmemb;
+    if ((uint64_t) size * nmemb > left) {
+        total_elements = left / size;
+    }
+
+    uint32_t total = total_elements * size;
+    if (total == 0) {
+        return 0;
+    }
+
+    int res = vfs_read(inode, desc->pos, total, (char*) ptr);
+    if (res < 0) {
         return res;
+    }
+
+    desc->pos += total;
+    return total_elements;
+}
+
+// Note: writes nmemb elements of size bytes at the current position (at the end for an appending file) and moves past them
+// Note: returns how many whole elements were written, fewer when the filesystem ran out of room
+int file_write(struct file_descriptor* desc, const void* ptr, uint32_t size, uint32_t nmemb) {
+    if (size == 0 || nmemb == 0 || desc->type != FILE_TYPE_FILE || (uint64_t) size * nmemb > 0x7FFFFFFF) {
+        return -EINVARG;
+    }
+    if (desc->mode == FILE_MODE_READ) {
+        return -ERDONLY;
+    }
+
+    struct vfs_inode* inode = desc->inode;
+    if (desc->mode == FILE_MODE_APPEND) {
+        desc->pos = inode->size;
+    }
+
+    int res = vfs_write(inode, desc->pos, size * nmemb, ptr);
+    if (res < 0) {
+        return res;
+    }
+
+    desc->pos += res;
+    return (uint32_t) res / size;
+}
+
+// Note: if successful, returns an index in the kernel's file_descriptor table, otherwise returns 0
+int fopen(const char* filename, const char* mode_str)
+{
+    struct file_descriptor* desc = file_open(filename, mode_str);
+    if (ISERR(desc)) {
+        return 0; // fopen shouldn't return negative values
+    }
+
+    int res = file_table_install(&kernel_files, desc);
+    if (res < 0) {
+        file_put(desc);
+        res = 0;
+    }
+    return res;
+}
+
+// Note: gets info on a file given descriptor index
+int fstat(int fd, struct file_stat* stat) {
+    struct file_descriptor* desc = file_table_get(&kernel_files, fd);
+    // Check: if the descriptor exists in the table
+    if (!desc) {
+        return -EIO;
+    }
+
+    return file_stat(desc, stat);
+}
+
+// Note: take file descriptor index and removes it from descriptor table
+int fclose(int fd) {
+    return file_table_close(&kernel_files, fd);
 }
 
 // Note: decide where to put the pointer, to read or write to the file
 int fseek(int fd, int offset, FILE_SEEK_MODE whence) {
-    int res = 0;
-    struct file_descriptor* desc = file_get_descriptor(fd);
+    struct file_descriptor* desc = file_table_get(&kernel_files, fd);
     // Check: if we get the descriptor
     if (!desc) {
-        res = -EIO;
-        goto out;
+        return -EIO;
     }
 
-    res = desc->filesystem->seek(desc->private, offset, whence);
-
-    out:
-        return res;
+    return file_seek(desc, offset, whence);
 }
 
 // Note: consults the filesystems read function, returns the amount read
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd) {
-    int res = 0;
-    // Check: if arguments are valid
-    if (size == 0 || nmemb == 0 || fd < 1)
-    {
-        res = -EINVARG;
-        goto out;
-    }
-
-    struct file_descriptor* desc = file_get_descriptor(fd);
+    struct file_descriptor* desc = file_table_get(&kernel_files, fd);
     // Check: if the index passed is actually in the file descriptor table in memory
-    if (!desc)
-    {
-        res = -EINVARG;
-        goto out;
+    if (!desc) {
+        return -EINVARG;
     }
-    
-    // Here: consults the filesystems read function
-    res = desc->filesystem->read(desc->disk, desc->private, size, nmemb, (char*) ptr);
-    out:
-        return res;
+
+    return file_read(desc, ptr, size, nmemb);
 }
 
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd) {
+    struct file_descriptor* desc = file_table_get(&kernel_files, fd);
+    if (!desc) {
+        return -EINVARG;
+    }
+
+    return file_write(desc, ptr, size, nmemb);
+}
@@ -2,6 +2,7 @@
 #define FILE_H
 
 #include <stdint.h>
+#include "config.h"
 #include "pparser.h"
 
 typedef unsigned int FILE_SEEK_MODE;
@@ -32,14 +33,59 @@ struct file_stat {
     uint32_t filesize;
 };
 
+typedef unsigned int FILE_TYPE;
+enum
+{
+    FILE_TYPE_FILE,
+    FILE_TYPE_DIRECTORY
+};
+
+enum {
+    FILE_DIRENT_DIRECTORY = 0b00000001,
+    FILE_DIRENT_READ_ONLY = 0b00000010,
+    FILE_DIRENT_HIDDEN    = 0b00000100
+};
+
+// One entry of a directory listing (32 bytes), dates and times are in the FAT on-disk format
+struct file_dirent {
+    char name[16];
+    uint32_t flags;
+    uint32_t size;
+    uint16_t creation_date;
+    uint16_t creation_time;
+    uint16_t last_mod_date;
+    uint16_t last_mod_time;
+};
+
 
 struct disk;
-typedef void*(*FS_OPEN_FUNCTION)(struct disk* disk, struct path_part* path, FILE_MODE mode_str);
-typedef int (*FS_READ_FUNCTION)(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+// Note: (at) is an open directory of the filesystem (from opendir) the path is walked from, 0 walks it from the root
+typedef void*(*FS_OPEN_FUNCTION)(struct disk* disk, void* at, struct path_view* path, FILE_MODE mode_str);
+// Reads (total) bytes from (offset) of an open file into (out), the caller keeps the read inside the file
+typedef int (*FS_READ_AT_FUNCTION)(struct disk* disk, void* private, uint32_t offset, uint32_t total, char* out);
+// Writes (total) bytes from (in) at (offset) of an open file, growing it if needed. Returns how many bytes were written
+typedef int (*FS_WRITE_AT_FUNCTION)(struct disk* disk, void* private, uint32_t offset, uint32_t total, const char* in);
+// Cuts an open file to (size) bytes, or grows it with zeros
+typedef int (*FS_TRUNCATE_FUNCTION)(struct disk* disk, void* private, uint32_t size);
+// Reserves the space (offset + length) bytes of an open file need, contiguous where it can, without changing its size
+typedef int (*FS_FALLOCATE_FUNCTION)(struct disk* disk, void* private, uint32_t offset, uint32_t length);
 typedef int (*FS_RESOLVE_FUNCTION)(struct disk* disk);
 typedef int (*FS_CLOSE_FUNCTION) (void* private);
-typedef int (*FS_SEEK_FUNCTION)(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode);
 typedef int (*FS_STAT_FUNCTION) (struct disk* disk, void* private, struct file_stat* stat);
+// A number that tells the files of one filesystem apart, opens of the same number share one inode (0 if the file has none)
+typedef uint32_t (*FS_INO_FUNCTION)(struct disk* disk, void* private);
+// Opens the directory (path) from (at), no components means the root directory (the VFS never asks for (at) itself)
+typedef void*(*FS_OPENDIR_FUNCTION)(struct disk* disk, void* at, struct path_view* path);
+// Fills up to (max) entries from where the last call stopped, returns how many (0 at the end)
+typedef int (*FS_READDIR_FUNCTION)(struct disk* disk, void* private, struct file_dirent* out, int max);
+// Creates the directory (path) from (at), its parent must exist
+typedef int (*FS_MKDIR_FUNCTION)(struct disk* disk, void* at, struct path_view* path);
+
+enum {
+    // The filesystem keeps file data in memory itself, the VFS does not put it in the page cache (its files can not be mapped)
+    FS_FLAG_NO_CACHE = 0b00000001
+};
+typedef unsigned int FS_FLAGS;
 
 
 struct filesystem
@@ -47,25 +93,60 @@ struct filesystem
     // Filesystem should return zero from resolve if the provided disk is using its filesystem
     FS_RESOLVE_FUNCTION resolve;
     FS_OPEN_FUNCTION open;
-    FS_READ_FUNCTION read;
-    FS_SEEK_FUNCTION seek;
+    FS_READ_AT_FUNCTION read_at;
+    // Optional, without them files can only be opened for reading
+    FS_WRITE_AT_FUNCTION write_at;
+    FS_TRUNCATE_FUNCTION truncate;
+    // Optional, a filesystem without it has nothing to reserve
+    FS_FALLOCATE_FUNCTION fallocate;
     FS_STAT_FUNCTION stat;
     FS_CLOSE_FUNCTION close;
+    // Optional, without it every open of a file gets an inode of its own
+    FS_INO_FUNCTION ino;
+    // Optional, needed to list directories. An open directory is closed with close
+    FS_OPENDIR_FUNCTION opendir;
+    FS_READDIR_FUNCTION readdir;
+    // Optional, needed to create directories
+    FS_MKDIR_FUNCTION mkdir;
+    FS_FLAGS flags;
 
     char name[20];
 };
 
+struct vfs_mount;
+struct vfs_inode;
+
+// An open file. Descriptor tables point at it, it is closed when the last reference goes away
+// Note: positions are per open file, everything else about a file lives in its inode
 struct file_descriptor
 {
-    // The descriptor index
-    int index;
-    struct filesystem* filesystem;
-
-    // This is basically a pointer to filesystems (e.g. FAT16) file descriptor (e.g. fat_file_descriptor structure)
+    // Table slots and other holders of this open file
+    int refcount;
+    // A file we read, or a directory we list
+    FILE_TYPE type;
+    // The mount the file was opened through
+    struct vfs_mount* mount;
+
+    // Files: the inode shared by every open of the file, and where the next read or write starts
+    struct vfs_inode* inode;
+    uint32_t pos;
+    // Files: how the file was opened, writes of an appending file always go to its end
+    FILE_MODE mode;
+
+    // Directories: the filesystem's handle from opendir (e.g. a fat_file_descriptor structure), and the directory's
+    // absolute path without "." or ".." in it. Relative paths are walked from the handle
     void* private;
+    char path[PEACHOS_MAX_PATH];
+};
 
-    // The disk that the file descriptor should be used on
-    struct disk* disk;
+// A descriptor table, every process has its own and the kernel has one for itself
+// Note: free slots are chained through (next_free), so handing out a descriptor is O(1)
+struct file_table
+{
+    struct file_descriptor* files[PEACHOS_MAX_FILE_DESCRIPTORS];
+    int next_free[PEACHOS_MAX_FILE_DESCRIPTORS];
+    // Index of the first free slot, -1 when the table is full
+    int free_head;
 };
 
 void fs_init();
@@ -73,9 +154,33 @@ void fs_init();
 void fs_insert_filesystem(struct filesystem* filesystem);
 struct filesystem* fs_resolve(struct disk* disk);
 
+struct pagecache_page;
+struct file_descriptor* file_open(const char* filename, const char* mode_str);
+struct file_descriptor* file_open_at(struct file_descriptor* at, const char* filename, const char* mode_str);
+void file_get(struct file_descriptor* desc);
+int file_put(struct file_descriptor* desc);
+int file_read(struct file_descriptor* desc, void* ptr, uint32_t size, uint32_t nmemb);
+int file_write(struct file_descriptor* desc, const void* ptr, uint32_t size, uint32_t nmemb);
+int file_seek(struct file_descriptor* desc, int offset, FILE_SEEK_MODE whence);
+int file_fallocate(struct file_descriptor* desc, uint32_t offset, uint32_t length);
+int file_stat(struct file_descriptor* desc, struct file_stat* stat);
+struct pagecache_page* file_get_page(struct file_descriptor* desc, uint32_t index);
+struct file_descriptor* file_opendir(const char* path);
+struct file_descriptor* file_opendir_at(struct file_descriptor* at, const char* path);
+int file_readdir(struct file_descriptor* desc, struct file_dirent* out, int max);
+int file_mkdir(const char* path);
+int file_mkdir_at(struct file_descriptor* at, const char* path);
+
+void file_table_init(struct file_table* table);
+int file_table_install(struct file_table* table, struct file_descriptor* desc);
+struct file_descriptor* file_table_get(struct file_table* table, int fd);
+int file_table_close(struct file_table* table, int fd);
+void file_table_close_all(struct file_table* table);
+
 int fopen(const char* filename, const char* mode);
 int fseek(int fd, int offset, FILE_SEEK_MODE whence);
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd);
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd);
 int fstat(int fd, struct file_stat* stat);
 int fclose(int fd);
 
@@ -0,0 +1,352 @@
+#include "pagecache.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// Note: page structures come from a fixed pool, only the page data and the tree tables are on the heap
+static struct pagecache_page pagecache_pages[PEACHOS_PAGECACHE_MAX_PAGES];
+static struct pagecache_page* pagecache_free_pages = 0;
+static int pagecache_initialized = 0;
+
+static struct pagecache_file* pagecache_files[PEACHOS_PAGECACHE_BUCKETS];
+static struct pagecache_page* pagecache_lru_head = 0;
+static struct pagecache_page* pagecache_lru_tail = 0;
+
+// Note: the free pool is chained through lru_next
+static void pagecache_init()
+{
+    for (int i = 0; i < PEACHOS_PAGECACHE_MAX_PAGES; i++)
+    {
+        pagecache_pages[i].lru_next = pagecache_free_pages;
+        pagecache_free_pages = &pagecache_pages[i];
+    }
+    pagecache_initialized = 1;
+}
+
+static unsigned int pagecache_hash(const void* owner, uint32_t id)
+{
+    return ((uint32_t) owner ^ (id * 2654435761u)) % PEACHOS_PAGECACHE_BUCKETS;
+}
+
+static void pagecache_lru_unlink(struct pagecache_page* page)
+{
+    if (page->lru_prev)
+        page->lru_prev->lru_next = page->lru_next;
+    else
+        pagecache_lru_head = page->lru_next;
+
+    if (page->lru_next)
+        page->lru_next->lru_prev = page->lru_prev;
+    else
+        pagecache_lru_tail = page->lru_prev;
+
+    page->lru_prev = 0;
+    page->lru_next = 0;
+}
+
+static void pagecache_lru_push_front(struct pagecache_page* page)
+{
+    page->lru_prev = 0;
+    page->lru_next = pagecache_lru_head;
+    if (pagecache_lru_head)
+        pagecache_lru_head->lru_prev = page;
+    pagecache_lru_head = page;
+    if (!pagecache_lru_tail)
+        pagecache_lru_tail = page;
+}
+
+static void pagecache_file_free(struct pagecache_file* file)
+{
+    struct pagecache_file** link = &pagecache_files[pagecache_hash(file->owner, file->id)];
+    while (*link != file)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = file->hash_next;
+
+    for (int i = 0; i < PAGECACHE_TREE_ENTRIES; i++)
+    {
+        if (file->tree[i])
+        {
+            kfree(file->tree[i]);
+        }
+    }
+    kfree(file->tree);
+    kfree(file);
+}
+
+// Note: the slot in the file's tree for (index), with create the table holding it is allocated when missing
+static struct pagecache_page** pagecache_slot(struct pagecache_file* file, uint32_t index, int create)
+{
+    uint32_t table = index / PAGECACHE_TREE_ENTRIES;
+    if (table >= PAGECACHE_TREE_ENTRIES)
+    {
+        return 0;
+    }
+
+    if (!file->tree[table])
+    {
+        if (!create)
+        {
+            return 0;
+        }
+
+        file->tree[table] = kzalloc(sizeof(struct pagecache_page*) * PAGECACHE_TREE_ENTRIES);
+        if (!file->tree[table])
+        {
+            return 0;
+        }
+    }
+
+    return &file->tree[table][index % PAGECACHE_TREE_ENTRIES];
+}
+
+static void pagecache_free_unlinked_page(struct pagecache_page* page);
+
+// Note: drops the page from its file and gives it back to the pool
+static void pagecache_evict(struct pagecache_page* page)
+{
+    struct pagecache_file* file = page->file;
+    *pagecache_slot(file, page->index, 0) = 0;
+    file->total_pages--;
+
+    pagecache_lru_unlink(page);
+    pagecache_free_unlinked_page(page);
+
+    if (file->total_pages == 0 && file->refcount == 0)
+    {
+        pagecache_file_free(file);
+    }
+}
+
+// Note: a page from the pool, evicting the least recently used page nobody holds when the pool is empty
+static struct pagecache_page* pagecache_new_page()
+{
+    if (!pagecache_initialized)
+    {
+        pagecache_init();
+    }
+
+    if (!pagecache_free_pages)
+    {
+        struct pagecache_page* victim = pagecache_lru_tail;
+        while (victim && victim->refcount)
+        {
+            victim = victim->lru_prev;
+        }
+
+        if (!victim)
+        {
+            return 0;
+        }
+        pagecache_evict(victim);
+    }
+
+    struct pagecache_page* page = pagecache_free_pages;
+    pagecache_free_pages = page->lru_next;
+    page->lru_next = 0;
+    return page;
+}
+
+// Note: finds the cache entry of the file (owner, id), creating it if it has none yet, and takes a reference on it
+struct pagecache_file* pagecache_file_get(const void* owner, uint32_t id)
+{
+    unsigned int bucket = pagecache_hash(owner, id);
+    struct pagecache_file* file = pagecache_files[bucket];
+    while (file && (file->owner != owner || file->id != id))
+    {
+        file = file->hash_next;
+    }
+
+    if (!file)
+    {
+        file = kzalloc(sizeof(struct pagecache_file));
+        if (!file)
+        {
+            return 0;
+        }
+
+        file->tree = kzalloc(sizeof(struct pagecache_page**) * PAGECACHE_TREE_ENTRIES);
+        if (!file->tree)
+        {
+            kfree(file);
+            return 0;
+        }
+
+        file->owner = owner;
+        file->id = id;
+        file->hash_next = pagecache_files[bucket];
+        pagecache_files[bucket] = file;
+    }
+
+    file->refcount++;
+    return file;
+}
+
+// Note: the pages stay cached after the last put, so the next open of the file finds them
+void pagecache_file_put(struct pagecache_file* file)
+{
+    file->refcount--;
+    if (file->refcount == 0 && file->total_pages == 0)
+    {
+        pagecache_file_free(file);
+    }
+}
+
+// Note: forgets every page of the file nobody holds, e.g. after the file changed on disk
+void pagecache_file_invalidate(struct pagecache_file* file)
+{
+    // Here: we hold the file ourselves so evicting its last page does not free it under us
+    file->refcount++;
+    for (int i = 0; i < PAGECACHE_TREE_ENTRIES && file->total_pages; i++)
+    {
+        if (!file->tree[i])
+        {
+            continue;
+        }
+
+        for (int j = 0; j < PAGECACHE_TREE_ENTRIES; j++)
+        {
+            struct pagecache_page* page = file->tree[i][j];
+            if (page && page->refcount == 0)
+            {
+                pagecache_evict(page);
+            }
+        }
+    }
+    pagecache_file_put(file);
+}
+
+// Note: the cached page (index) of the file with a reference taken, or 0 when it is not cached
+struct pagecache_page* pagecache_lookup(struct pagecache_file* file, uint32_t index)
+{
+    struct pagecache_page** slot = pagecache_slot(file, index, 0);
+    if (!slot || !*slot)
+    {
+        return 0;
+    }
+
+    struct pagecache_page* page = *slot;
+    page->refcount++;
+    pagecache_lru_unlink(page);
+    pagecache_lru_push_front(page);
+    return page;
+}
+
+int pagecache_contains(struct pagecache_file* file, uint32_t index)
+{
+    struct pagecache_page** slot = pagecache_slot(file, index, 0);
+    return slot && *slot;
+}
+
+// Note: a page with its data block for (file), the file is pinned while we make room so it is not freed under us
+static struct pagecache_page* pagecache_alloc_page(struct pagecache_file* file)
+{
+    file->refcount++;
+    struct pagecache_page* page = pagecache_new_page();
+    void* page_data = page ? kmalloc(PEACHOS_PAGECACHE_PAGE_SIZE) : 0;
+    file->refcount--;
+    if (!page_data)
+    {
+        if (page)
+        {
+            page->lru_next = pagecache_free_pages;
+            pagecache_free_pages = page;
+        }
+        return 0;
+    }
+
+    page->data = page_data;
+    return page;
+}
+
+static void pagecache_free_unlinked_page(struct pagecache_page* page)
+{
+    kfree(page->data);
+    memset(page, 0, sizeof(struct pagecache_page));
+    page->lru_next = pagecache_free_pages;
+    pagecache_free_pages = page;
+}
+
+static void pagecache_link(struct pagecache_file* file, struct pagecache_page** slot, struct pagecache_page* page, uint32_t index)
+{
+    page->file = file;
+    page->index = index;
+    *slot = page;
+    file->total_pages++;
+    pagecache_lru_push_front(page);
+}
+
+// Note: caches a copy of (size) bytes as page (index) of the file, the rest of the page is zero (e.g. the last page)
+int pagecache_insert(struct pagecache_file* file, uint32_t index, const void* data, uint32_t size)
+{
+    if (size > PEACHOS_PAGECACHE_PAGE_SIZE)
+    {
+        return -EINVARG;
+    }
+
+    struct pagecache_page** slot = pagecache_slot(file, index, 1);
+    if (!slot)
+    {
+        return -ENOMEM;
+    }
+
+    // Note: already cached, the data is the same
+    if (*slot)
+    {
+        return 0;
+    }
+
+    struct pagecache_page* page = pagecache_alloc_page(file);
+    if (!page)
+    {
+        return -ENOMEM;
+    }
+
+    memcpy(page->data, (void*) data, size);
+    memset(page->data + size, 0, PEACHOS_PAGECACHE_PAGE_SIZE - size);
+    pagecache_link(file, slot, page, index);
+    return 0;
+}
+
+// Note: like pagecache_lookup, but a page that is not cached is read by (fill) straight into a new page first
+// Note: (fill) gets the page data to fill in, it must zero what lies past the end of the file
+struct pagecache_page* pagecache_fill(struct pagecache_file* file, uint32_t index, PAGECACHE_FILL_FUNCTION fill, void* private)
+{
+    struct pagecache_page* page = pagecache_lookup(file, index);
+    if (page)
+    {
+        return page;
+    }
+
+    struct pagecache_page** slot = pagecache_slot(file, index, 1);
+    if (!slot)
+    {
+        return 0;
+    }
+
+    page = pagecache_alloc_page(file);
+    if (!page)
+    {
+        return 0;
+    }
+
+    if (fill(private, index, page->data) < 0)
+    {
+        pagecache_free_unlinked_page(page);
+        return 0;
+    }
+
+    pagecache_link(file, slot, page, index);
+    page->refcount = 1;
+    return page;
+}
+
+void pagecache_put(struct pagecache_page* page)
+{
+    if (page && page->refcount > 0)
+    {
+        page->refcount--;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Reads page (index) of a file into (data), returns a negative status on failure
+typedef int (*PAGECACHE_FILL_FUNCTION)(void* private, uint32_t index, void* data);
+
+// Pages of a file are found through a two level tree, like a page directory: 1024 tables of 1024 pages cover 4 GiB
+#define PAGECACHE_TREE_ENTRIES 1024
+
+// One cached page of a file, its data is a whole 4 KiB heap block
+struct pagecache_page
+{
+    struct pagecache_file* file;
+    uint32_t index;
+    void* data;
+
+    // Holders that need the page to stay put (e.g. a mapping), only pages at zero may be evicted
+    int refcount;
+
+    // Most recently used first
+    struct pagecache_page* lru_prev;
+    struct pagecache_page* lru_next;
+};
+
+// The cached pages of one file, (owner, id) is what identifies the file (e.g. the disk and the first cluster)
+struct pagecache_file
+{
+    const void* owner;
+    uint32_t id;
+
+    // tree[index / PAGECACHE_TREE_ENTRIES][index % PAGECACHE_TREE_ENTRIES], tables are allocated as pages come in
+    struct pagecache_page*** tree;
+    int total_pages;
+
+    // Open files using this entry, it is freed when nobody uses it and it has no pages left
+    int refcount;
+    struct pagecache_file* hash_next;
+};
+
+struct pagecache_file* pagecache_file_get(const void* owner, uint32_t id);
+void pagecache_file_put(struct pagecache_file* file);
+void pagecache_file_invalidate(struct pagecache_file* file);
+
+struct pagecache_page* pagecache_lookup(struct pagecache_file* file, uint32_t index);
+int pagecache_contains(struct pagecache_file* file, uint32_t index);
+int pagecache_insert(struct pagecache_file* file, uint32_t index, const void* data, uint32_t size);
+struct pagecache_page* pagecache_fill(struct pagecache_file* file, uint32_t index, PAGECACHE_FILL_FUNCTION fill, void* private);
+void pagecache_put(struct pagecache_page* page);
+
+#endif
@@ -1,7 +1,6 @@
 #include "pparser.h"
 #include "kernel.h"
 #include "string/string.h"
-#include "memory/heap/kheap.h"
 #include "memory/memory.h"
 #include "status.h"
 
@@ -25,123 +24,109 @@ static int pathparser_get_drive_by_path(const char** path)
     return drive_no;
 }
 
-static struct path_root* pathparser_create_root(int drive_number)
+/* 
+    first it checks the paths validity, and then goes on to...
+    it copies the part after the drive into view->buffer and splits it there in place: every '/' becomes a null
+    terminator and each component is recorded as a pointer and a length into the buffer. Nothing is allocated,
+    so the view can live on the caller's stack */
+// Note: empty components ("0:/a//b") are skipped, a path with no components at all is valid and names the root
+// Note: a path without a drive is relative (drive_no is -1), "." is dropped and ".." takes back the component before it
+int pathparser_parse(const char* path, struct path_view* view)
 {
-    struct path_root* path_r = kzalloc(sizeof(struct path_root));
-    path_r->drive_no = drive_number;
-    path_r->first = 0;
-    return path_r;
-}
-
+    const char* tmp_path = path;
+    view->total = 0;
+    view->up = 0;
+    view->relative = 0;
 
-static const char* pathparser_get_path_part(const char** path)
-{
-    char* result_path_part = kzalloc(PEACHOS_MAX_PATH);
-    int i = 0;
-    while(**path != '/' && **path != 0x00)
+    // Check: if the length is valid
+    int len = strnlen(path, PEACHOS_MAX_PATH);
+    if (len >= PEACHOS_MAX_PATH)
     {
-        result_path_part[i] = **path;
-        *path += 1;
-        i++;
+        return -EBADPATH;
     }
-
-    if (**path == '/')
+    // Check: if drive exists, a path that does not start with one is relative
+    int res = pathparser_path_valid_format(path) ? pathparser_get_drive_by_path(&tmp_path) : -1;
+    if (res < 0)
     {
-        // Skip the forward slash to avoid problems
-        *path += 1;
+        // Check: "0:" alone or a leading '/' name neither a drive nor a relative path
+        if (path[0] == '/' || (isdigit(path[0]) && path[1] == ':'))
+        {
+            return -EBADPATH;
+        }
+        view->relative = 1;
     }
+    view->drive_no = res;
 
-    if(i == 0)
+    strncpy(view->buffer, tmp_path, sizeof(view->buffer));
+    char* ptr = view->buffer;
+    while (*ptr)
     {
-        kfree(result_path_part);
-        result_path_part = 0;
+        char* start = ptr;
+        while (*ptr != '/' && *ptr != 0x00)
+        {
+            ptr++;
+        }
+
+        int length = ptr - start;
+        if (*ptr == '/')
+        {
+            *ptr++ = 0x00;
+        }
+
+        if (length == 0 || (length == 1 && start[0] == '.'))
+        {
+            continue;
+        }
+
+        // Here: ".." above the root stays at the root, above the start of a relative path it is counted
+        if (length == 2 && start[0] == '.' && start[1] == '.')
+        {
+            if (view->total > 0)
+            {
+                view->total--;
+            }
+            else if (view->relative)
+            {
+                view->up++;
+            }
+            continue;
+        }
+
+        view->components[view->total].name = start;
+        view->components[view->total].length = length;
+        view->total++;
     }
 
-    return result_path_part;
+    return 0;
 }
 
-struct path_part* pathparser_parse_path_part(struct path_part* last_part, const char** path)
+// Note: writes the directory (base) followed by the components of (view) into (out), e.g. "0:/bin" and "tools" give
+// "0:/bin/tools". (base) has no trailing slash unless it is a drive's root. Returns -EBADPATH when it does not fit
+int pathparser_format(const char* base, struct path_view* view, char* out)
 {
-    const char* path_part_str = pathparser_get_path_part(path);
-    if (!path_part_str)
+    int len = strnlen(base, PEACHOS_MAX_PATH);
+    if (len >= PEACHOS_MAX_PATH)
     {
-        return 0;
-    }
-
-    struct path_part* part = kzalloc(sizeof(struct path_part));
-    part->part = path_part_str;
-    part->next = 0x00;
-
-    if (last_part)
-    {
-        last_part->next = part;
+        return -EBADPATH;
     }
+    strncpy(out, base, PEACHOS_MAX_PATH);
 
-    return part;
-}
-
-void pathparser_free(struct path_root* root)
-{
-    struct path_part* part = root->first;
-    while(part)
+    for (int i = 0; i < view->total; i++)
     {
-        struct path_part* next_part = part->next;
-        kfree((void*) part->part);
-        kfree(part);
-        part = next_part;
+        int separator = out[len - 1] != '/';
+        if (len + separator + view->components[i].length >= PEACHOS_MAX_PATH)
+        {
+            return -EBADPATH;
+        }
+
+        if (separator)
+        {
+            out[len++] = '/';
+        }
+        memcpy(&out[len], (void*) view->components[i].name, view->components[i].length);
+        len += view->components[i].length;
+        out[len] = 0x00;
     }
 
-    kfree(root);
+    return 0;
 }
-
-/* 
-    first it checks the paths validity, and then goes on to...
-    it creates a location on the heap, with the size of the path_root structure. 
-    And inside the root_path structure in it with the values: drive no:, and path part(s). And returns the 
-    address of the heap location */
- // for now, current_directory_path is not used. maybe in the future. for now we only accept absolute path
-struct path_root* pathparser_parse(const char* path, const char* current_directory_path)
-{
-    int res = 0;
-    const char* tmp_path = path;
-    struct path_root* path_root = 0;
-
-    // Check: if the length is valid
-    if (strlen(path) > PEACHOS_MAX_PATH)
-    {
-        goto out;
-    }
-    // Check: if drive exists
-    res = pathparser_get_drive_by_path(&tmp_path);
-    if (res < 0)
-    {
-        goto out;
-    }
-    // Check: if there is enough memory to create the path_root structure
-    path_root = pathparser_create_root(res);
-    if (!path_root)
-    {
-        goto out;
-    }
-
-    struct path_part* first_part = pathparser_parse_path_part(NULL, &tmp_path);
-    if (!first_part)
-    {
-        goto out;
-    }
-
-    path_root->first = first_part;
-    struct path_part* part = pathparser_parse_path_part(first_part, &tmp_path);
-    while(part)
-    {
-        part = pathparser_parse_path_part(part, &tmp_path);
-    }
-    
-out:
-    /* 
-    first it checks the paths validity, and then goes on to...
-    it creates a location on the heap, with the size of the path_root structure. 
-    And inside the root_path structure in it with the values: drive no:, and path part(s). And returns the 
-    address of the heap location */
-    return path_root;
-}
\ No newline at end of file
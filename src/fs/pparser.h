@@ -1,19 +1,34 @@
 #ifndef PATHPARSER_H
 #define PATHPARSER_H
 
-struct path_root
+#include "config.h"
+
+// Most components a path can have: each one is at least a character and a slash
+#define PEACHOS_MAX_PATH_COMPONENTS (PEACHOS_MAX_PATH / 2)
+
+// A view of one component inside path_view.buffer: (length) characters at (name), also null terminated
+struct path_component
 {
-    int drive_no;
-    struct path_part* first;
+    const char* name;
+    int length;
 };
 
-struct path_part
+// A parsed path, all of it lives in the structure itself so the caller can keep it on the stack
+// Note: "." and ".." are resolved while parsing, (up) counts the ".." a relative path has left over at its start
+struct path_view
 {
-    const char* part;
-    struct path_part* next;
+    // Relative paths ("bin/shell.elf") have no drive, they are looked up from some directory
+    int relative;
+    int drive_no;
+    int up;
+    int total;
+    struct path_component components[PEACHOS_MAX_PATH_COMPONENTS];
+
+    // The path after the drive, every '/' replaced by a null terminator
+    char buffer[PEACHOS_MAX_PATH];
 };
 
-struct path_root* pathparser_parse(const char* path, const char* current_directory_path);
-void pathparser_free(struct path_root* root);
+int pathparser_parse(const char* path, struct path_view* view);
+int pathparser_format(const char* base, struct path_view* view, char* out);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,439 @@
+#include "kernel.h"
+#include "tmpfs.h"
+#include "string/string.h"
+#include "disk/disk.h"
+#include "fs/vfs.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "status.h"
+#include <stdint.h>
+
+// Pages of a file are found through a two level tree, like the page cache's: 1024 tables of 1024 pages cover 4 GiB
+#define TMPFS_PAGE_SIZE 4096
+#define TMPFS_TREE_ENTRIES 1024
+
+// A file or a directory, it lives in memory only and is gone when the machine is
+struct tmpfs_node
+{
+    char name[PEACHOS_TMPFS_MAX_NAME];
+    FILE_TYPE type;
+
+    // Files: the data, pages[index / TMPFS_TREE_ENTRIES][index % TMPFS_TREE_ENTRIES]. Tables and pages are allocated as
+    // the file grows, a page that is missing reads as zeros
+    uint32_t size;
+    char*** pages;
+
+    // Directories: the children in the order they were created, chained through next
+    struct tmpfs_node* parent;
+    struct tmpfs_node* children;
+    struct tmpfs_node* last_child;
+    struct tmpfs_node* next;
+};
+
+// What tmpfs hands out from open and opendir
+struct tmpfs_handle
+{
+    struct tmpfs_node* node;
+    // Open directories: the child readdir hands out next
+    struct tmpfs_node* next_child;
+};
+
+int tmpfs_resolve(struct disk* disk);
+void* tmpfs_open(struct disk* disk, void* at, struct path_view* path, FILE_MODE mode);
+int tmpfs_read_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, char* out);
+int tmpfs_write_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, const char* in);
+int tmpfs_truncate(struct disk* disk, void* private, uint32_t size);
+int tmpfs_stat(struct disk* disk, void* private, struct file_stat* stat);
+int tmpfs_close(void* private);
+uint32_t tmpfs_ino(struct disk* disk, void* private);
+void* tmpfs_opendir(struct disk* disk, void* at, struct path_view* path);
+int tmpfs_readdir(struct disk* disk, void* private, struct file_dirent* out, int max);
+int tmpfs_mkdir(struct disk* disk, void* at, struct path_view* path);
+
+
+// Note: the data is in memory already, caching it in the page cache would only keep a second copy
+struct filesystem tmpfs_fs =
+{
+    .resolve = tmpfs_resolve,
+    .open = tmpfs_open,
+    .read_at = tmpfs_read_at,
+    .write_at = tmpfs_write_at,
+    .truncate = tmpfs_truncate,
+    .stat = tmpfs_stat,
+    .close = tmpfs_close,
+    .ino = tmpfs_ino,
+    .opendir = tmpfs_opendir,
+    .readdir = tmpfs_readdir,
+    .mkdir = tmpfs_mkdir,
+    .flags = FS_FLAG_NO_CACHE
+};
+
+struct filesystem* tmpfs_init() {
+    strcpy(tmpfs_fs.name, "TMPFS");
+    return &tmpfs_fs;
+}
+
+// Note: tmpfs only takes the disks tmpfs_mount makes, there is nothing on them to read. The root directory is its state
+int tmpfs_resolve(struct disk* disk) {
+    if (disk->type != PEACHOS_DISK_TYPE_TMPFS) {
+        return -EFSNOTUS;
+    }
+
+    struct tmpfs_node* root = kzalloc(sizeof(struct tmpfs_node));
+    if (!root) {
+        return -ENOMEM;
+    }
+
+    root->type = FILE_TYPE_DIRECTORY;
+    disk->fs_private = root;
+    return 0;
+}
+
+// Note: makes an empty tmpfs and mounts it at drive (drive_no). The disk carrying it is not one of the registered disks
+int tmpfs_mount(int drive_no) {
+    int res = 0;
+    struct disk* disk = disk_new();
+    if (!disk) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    disk->type = PEACHOS_DISK_TYPE_TMPFS;
+    disk->id = drive_no;
+    disk->filesystem = fs_resolve(disk);
+    if (!disk->filesystem) {
+        res = -EFSNOTUS;
+        goto out;
+    }
+
+    res = vfs_mount(drive_no, disk);
+
+out:
+    if (res < 0 && disk) {
+        if (disk->fs_private) {
+            kfree(disk->fs_private);
+        }
+        kfree(disk);
+    }
+    return res;
+}
+
+static struct tmpfs_node* tmpfs_find_child(struct tmpfs_node* directory, const char* name) {
+    for (struct tmpfs_node* child = directory->children; child; child = child->next) {
+        if (strncmp(child->name, name, PEACHOS_TMPFS_MAX_NAME) == 0) {
+            return child;
+        }
+    }
+
+    return 0;
+}
+
+// Note: walks the first (total) components of the path from the open directory (at) or the root, 0 when one of them does not exist
+static struct tmpfs_node* tmpfs_lookup(struct disk* disk, void* at, struct path_view* path, int total) {
+    struct tmpfs_node* node = at ? ((struct tmpfs_handle*) at)->node : disk->fs_private;
+    for (int i = 0; i < total && node; i++) {
+        if (node->type != FILE_TYPE_DIRECTORY) {
+            return 0;
+        }
+        node = tmpfs_find_child(node, path->components[i].name);
+    }
+
+    return node;
+}
+
+// Note: creates (name) at the end of the directory, names are case sensitive and must fit a directory entry
+static struct tmpfs_node* tmpfs_new_node(struct tmpfs_node* directory, const char* name, FILE_TYPE type) {
+    if (strlen(name) >= PEACHOS_TMPFS_MAX_NAME) {
+        return ERROR(-EBADPATH);
+    }
+
+    struct tmpfs_node* node = kzalloc(sizeof(struct tmpfs_node));
+    if (!node) {
+        return ERROR(-ENOMEM);
+    }
+
+    strncpy(node->name, name, PEACHOS_TMPFS_MAX_NAME);
+    node->type = type;
+    node->parent = directory;
+    if (directory->last_child) {
+        directory->last_child->next = node;
+    }
+    else {
+        directory->children = node;
+    }
+    directory->last_child = node;
+    return node;
+}
+
+// Note: the page holding byte (index * TMPFS_PAGE_SIZE) of the file, with create missing tables and pages are allocated
+static char* tmpfs_page(struct tmpfs_node* node, uint32_t index, int create) {
+    uint32_t table = index / TMPFS_TREE_ENTRIES;
+    uint32_t entry = index % TMPFS_TREE_ENTRIES;
+    if (!node->pages) {
+        if (!create) {
+            return 0;
+        }
+        node->pages = kzalloc(sizeof(char**) * TMPFS_TREE_ENTRIES);
+        if (!node->pages) {
+            return 0;
+        }
+    }
+
+    if (!node->pages[table]) {
+        if (!create) {
+            return 0;
+        }
+        node->pages[table] = kzalloc(sizeof(char*) * TMPFS_TREE_ENTRIES);
+        if (!node->pages[table]) {
+            return 0;
+        }
+    }
+
+    if (!node->pages[table][entry] && create) {
+        node->pages[table][entry] = kzalloc(TMPFS_PAGE_SIZE);
+    }
+    return node->pages[table][entry];
+}
+
+// Note: frees every page from (first) on, and the tables left empty by that
+static void tmpfs_free_pages_from(struct tmpfs_node* node, uint32_t first) {
+    if (!node->pages) {
+        return;
+    }
+
+    for (uint32_t table = first / TMPFS_TREE_ENTRIES; table < TMPFS_TREE_ENTRIES; table++) {
+        char** pages = node->pages[table];
+        if (!pages) {
+            continue;
+        }
+
+        uint32_t entry = table == first / TMPFS_TREE_ENTRIES ? first % TMPFS_TREE_ENTRIES : 0;
+        int keep_table = entry != 0;
+        for (; entry < TMPFS_TREE_ENTRIES; entry++) {
+            if (pages[entry]) {
+                kfree(pages[entry]);
+                pages[entry] = 0;
+            }
+        }
+
+        if (!keep_table) {
+            kfree(pages);
+            node->pages[table] = 0;
+        }
+    }
+
+    if (first == 0) {
+        kfree(node->pages);
+        node->pages = 0;
+    }
+}
+
+// Note: opens a file, writing and appending create it when it does not exist yet (the VFS empties it for writing)
+void* tmpfs_open(struct disk* disk, void* at, struct path_view* path, FILE_MODE mode) {
+    int res = 0;
+    struct tmpfs_handle* handle = 0;
+    struct tmpfs_node* directory = tmpfs_lookup(disk, at, path, path->total - 1);
+    if (!directory || directory->type != FILE_TYPE_DIRECTORY) {
+        res = -EIO;
+        goto out;
+    }
+
+    const char* name = path->components[path->total - 1].name;
+    struct tmpfs_node* node = tmpfs_find_child(directory, name);
+    if (!node) {
+        if (mode == FILE_MODE_READ) {
+            res = -EIO;
+            goto out;
+        }
+
+        node = tmpfs_new_node(directory, name, FILE_TYPE_FILE);
+        if (ISERR(node)) {
+            res = ERROR_I(node);
+            goto out;
+        }
+    }
+
+    // Check: directories are listed, not opened
+    if (node->type != FILE_TYPE_FILE) {
+        res = -EINVARG;
+        goto out;
+    }
+
+    handle = kzalloc(sizeof(struct tmpfs_handle));
+    if (!handle) {
+        res = -ENOMEM;
+        goto out;
+    }
+    handle->node = node;
+
+out:
+    if (res < 0) {
+        return ERROR(res);
+    }
+    return handle;
+}
+
+// Note: copies (total) bytes from (offset) out of the file's pages, a hole (a page never written) reads as zeros
+int tmpfs_read_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, char* out) {
+    struct tmpfs_node* node = ((struct tmpfs_handle*) private)->node;
+    while (total > 0) {
+        uint32_t page_offset = offset % TMPFS_PAGE_SIZE;
+        uint32_t chunk = TMPFS_PAGE_SIZE - page_offset;
+        if (chunk > total) {
+            chunk = total;
+        }
+
+        char* page = tmpfs_page(node, offset / TMPFS_PAGE_SIZE, 0);
+        if (page) {
+            memcpy(out, page + page_offset, chunk);
+        }
+        else {
+            memset(out, 0, chunk);
+        }
+
+        offset += chunk;
+        out += chunk;
+        total -= chunk;
+    }
+
+    return 0;
+}
+
+/* Note: copies (total) bytes into the file at (offset), allocating pages as it goes. Pages are found by index, so
+appending costs the same however long the file is. Returns how much was written, short when we ran out of memory */
+int tmpfs_write_at(struct disk* disk, void* private, uint32_t offset, uint32_t total, const char* in) {
+    struct tmpfs_node* node = ((struct tmpfs_handle*) private)->node;
+
+    // Check: the file can not grow past 4 GiB
+    if (total > 0xFFFFFFFF - offset) {
+        total = 0xFFFFFFFF - offset;
+    }
+
+    uint32_t written = 0;
+    while (written < total) {
+        uint32_t page_offset = offset % TMPFS_PAGE_SIZE;
+        uint32_t chunk = TMPFS_PAGE_SIZE - page_offset;
+        if (chunk > total - written) {
+            chunk = total - written;
+        }
+
+        char* page = tmpfs_page(node, offset / TMPFS_PAGE_SIZE, 1);
+        if (!page) {
+            break;
+        }
+
+        memcpy(page + page_offset, (void*) in, chunk);
+        offset += chunk;
+        in += chunk;
+        written += chunk;
+        if (offset > node->size) {
+            node->size = offset;
+        }
+    }
+
+    if (written == 0 && total > 0) {
+        return -ENOMEM;
+    }
+    return written;
+}
+
+// Note: cuts the file to (size) bytes, or makes it longer with a hole that reads as zeros
+int tmpfs_truncate(struct disk* disk, void* private, uint32_t size) {
+    struct tmpfs_node* node = ((struct tmpfs_handle*) private)->node;
+    if (size < node->size) {
+        uint32_t first_free = (size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE;
+        tmpfs_free_pages_from(node, first_free);
+
+        // Here: the part of the last page past the end must read as zeros if the file grows again
+        char* page = size % TMPFS_PAGE_SIZE ? tmpfs_page(node, size / TMPFS_PAGE_SIZE, 0) : 0;
+        if (page) {
+            memset(page + size % TMPFS_PAGE_SIZE, 0, TMPFS_PAGE_SIZE - size % TMPFS_PAGE_SIZE);
+        }
+    }
+
+    node->size = size;
+    return 0;
+}
+
+int tmpfs_stat(struct disk* disk, void* private, struct file_stat* stat) {
+    struct tmpfs_node* node = ((struct tmpfs_handle*) private)->node;
+    if (node->type != FILE_TYPE_FILE) {
+        return -EINVARG;
+    }
+
+    stat->filesize = node->size;
+    stat->flags = 0x00;
+    return 0;
+}
+
+int tmpfs_close(void* private) {
+    kfree(private);
+    return 0;
+}
+
+// Note: nodes are never freed, so where one lives tells it apart for as long as the machine runs
+uint32_t tmpfs_ino(struct disk* disk, void* private) {
+    return (uint32_t) ((struct tmpfs_handle*) private)->node;
+}
+
+// Note: opens a directory for listing, no components means the root directory
+void* tmpfs_opendir(struct disk* disk, void* at, struct path_view* path) {
+    struct tmpfs_node* node = tmpfs_lookup(disk, at, path, path->total);
+    if (!node) {
+        return ERROR(-EIO);
+    }
+    if (node->type != FILE_TYPE_DIRECTORY) {
+        return ERROR(-EINVARG);
+    }
+
+    struct tmpfs_handle* handle = kzalloc(sizeof(struct tmpfs_handle));
+    if (!handle) {
+        return ERROR(-ENOMEM);
+    }
+
+    handle->node = node;
+    handle->next_child = node->children;
+    return handle;
+}
+
+// Note: fills up to (max) entries from the child after the one the last call stopped at, returns how many
+int tmpfs_readdir(struct disk* disk, void* private, struct file_dirent* out, int max) {
+    struct tmpfs_handle* handle = private;
+    int total = 0;
+    while (total < max && handle->next_child) {
+        struct tmpfs_node* child = handle->next_child;
+        struct file_dirent* dirent = &out[total++];
+        memset(dirent, 0, sizeof(struct file_dirent));
+        strncpy(dirent->name, child->name, sizeof(dirent->name));
+        if (child->type == FILE_TYPE_DIRECTORY) {
+            dirent->flags |= FILE_DIRENT_DIRECTORY;
+        }
+        dirent->size = child->size;
+        handle->next_child = child->next;
+    }
+
+    return total;
+}
+
+// Note: creates the directory (path), its parent has to exist already
+int tmpfs_mkdir(struct disk* disk, void* at, struct path_view* path) {
+    if (path->total == 0) {
+        return -EISTKN;
+    }
+
+    struct tmpfs_node* directory = tmpfs_lookup(disk, at, path, path->total - 1);
+    if (!directory || directory->type != FILE_TYPE_DIRECTORY) {
+        return -EIO;
+    }
+
+    const char* name = path->components[path->total - 1].name;
+    if (tmpfs_find_child(directory, name)) {
+        return -EISTKN;
+    }
+
+    struct tmpfs_node* node = tmpfs_new_node(directory, name, FILE_TYPE_DIRECTORY);
+    if (ISERR(node)) {
+        return ERROR_I(node);
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "fs/file.h"
+struct filesystem* tmpfs_init();
+int tmpfs_mount(int drive_no);
+#endif
@@ -0,0 +1,397 @@
+#include "vfs.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "disk/disk.h"
+#include "fs/pagecache.h"
+#include "memory/memory.h"
+
+// Note: one slot per drive number a path can name, a mount without a filesystem is free
+static struct vfs_mount vfs_mounts[PEACHOS_VFS_MAX_MOUNTS];
+
+// Note: inodes come from a fixed pool, like the dentry cache, opening a file that is open already costs no heap
+static struct vfs_inode vfs_inodes[PEACHOS_VFS_MAX_INODES];
+static struct vfs_inode* vfs_inode_buckets[PEACHOS_VFS_INODE_BUCKETS];
+
+// Note: puts the filesystem of (disk) at drive (drive_no), the disk must have been resolved already
+int vfs_mount(int drive_no, struct disk* disk)
+{
+    if (drive_no < 0 || drive_no >= PEACHOS_VFS_MAX_MOUNTS)
+    {
+        return -EINVARG;
+    }
+
+    if (!disk->filesystem)
+    {
+        return -EFSNOTUS;
+    }
+
+    struct vfs_mount* mount = &vfs_mounts[drive_no];
+    if (mount->filesystem)
+    {
+        return -EISTKN;
+    }
+
+    mount->drive_no = drive_no;
+    mount->filesystem = disk->filesystem;
+    mount->disk = disk;
+    return 0;
+}
+
+// Note: mounts every disk we found a filesystem on at its own drive number, the way paths always named them
+void vfs_mount_disks()
+{
+    for (int i = 0; i < PEACHOS_MAX_DISKS; i++)
+    {
+        struct disk* disk = disk_get(i);
+        if (disk && disk->filesystem)
+        {
+            vfs_mount(i, disk);
+        }
+    }
+}
+
+// Note: the mount serving drive (drive_no), or 0 when nothing is mounted there
+struct vfs_mount* vfs_get_mount(int drive_no)
+{
+    if (drive_no < 0 || drive_no >= PEACHOS_VFS_MAX_MOUNTS || !vfs_mounts[drive_no].filesystem)
+    {
+        return 0;
+    }
+
+    return &vfs_mounts[drive_no];
+}
+
+static unsigned int vfs_inode_hash(struct vfs_mount* mount, uint32_t ino)
+{
+    return ((unsigned int) mount * 31 + ino) % PEACHOS_VFS_INODE_BUCKETS;
+}
+
+static struct vfs_inode* vfs_inode_find(struct vfs_mount* mount, uint32_t ino)
+{
+    struct vfs_inode* inode = vfs_inode_buckets[vfs_inode_hash(mount, ino)];
+    while (inode && (inode->mount != mount || inode->ino != ino))
+    {
+        inode = inode->hash_next;
+    }
+
+    return inode;
+}
+
+static struct vfs_inode* vfs_inode_new()
+{
+    for (int i = 0; i < PEACHOS_VFS_MAX_INODES; i++)
+    {
+        if (!vfs_inodes[i].used)
+        {
+            return &vfs_inodes[i];
+        }
+    }
+
+    return 0;
+}
+
+/* Note: the inode of a file the filesystem of (mount) just opened as (private), with a reference taken. The inode takes
+over the handle: when the file is open already we close it and share the open one, so every open of a file sees the same
+metadata and the same cached pages. Returns an ERROR() pointer on failure, the handle is closed then too */
+struct vfs_inode* vfs_inode_get(struct vfs_mount* mount, void* private)
+{
+    int res = 0;
+    struct filesystem* fs = mount->filesystem;
+    struct vfs_inode* inode = 0;
+
+    uint32_t ino = fs->ino ? fs->ino(mount->disk, private) : 0;
+    if (ino)
+    {
+        inode = vfs_inode_find(mount, ino);
+        if (inode)
+        {
+            fs->close(private);
+            inode->refcount++;
+            return inode;
+        }
+    }
+
+    inode = vfs_inode_new();
+    if (!inode)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    struct file_stat stat;
+    res = fs->stat(mount->disk, private, &stat);
+    if (res < 0)
+    {
+        inode = 0;
+        goto out;
+    }
+
+    inode->used = 1;
+    inode->mount = mount;
+    inode->ino = ino;
+    inode->size = stat.filesize;
+    inode->flags = stat.flags;
+    inode->private = private;
+    inode->refcount = 1;
+
+    // Note: a file without a number can not be found again, it is never hashed
+    if (ino)
+    {
+        unsigned int bucket = vfs_inode_hash(mount, ino);
+        inode->hash_next = vfs_inode_buckets[bucket];
+        vfs_inode_buckets[bucket] = inode;
+    }
+
+out:
+    if (res < 0)
+    {
+        fs->close(private);
+        return ERROR(res);
+    }
+    return inode;
+}
+
+// Note: drops a reference, the last one closes the filesystem's handle. The cached pages outlive the inode
+void vfs_inode_put(struct vfs_inode* inode)
+{
+    inode->refcount--;
+    if (inode->refcount > 0)
+    {
+        return;
+    }
+
+    if (inode->ino)
+    {
+        struct vfs_inode** link = &vfs_inode_buckets[vfs_inode_hash(inode->mount, inode->ino)];
+        while (*link != inode)
+        {
+            link = &(*link)->hash_next;
+        }
+        *link = inode->hash_next;
+    }
+
+    inode->mount->filesystem->close(inode->private);
+    if (inode->cache)
+    {
+        pagecache_file_put(inode->cache);
+    }
+    memset(inode, 0, sizeof(struct vfs_inode));
+}
+
+// Note: the page cache entry of the file, files are told apart by (mount, ino). 0 when the file can not be cached
+static struct pagecache_file* vfs_inode_cache(struct vfs_inode* inode)
+{
+    if (!inode->cache && inode->ino && !(inode->mount->filesystem->flags & FS_FLAG_NO_CACHE))
+    {
+        inode->cache = pagecache_file_get(inode->mount, inode->ino);
+    }
+
+    return inode->cache;
+}
+
+static int vfs_read_uncached(struct vfs_inode* inode, uint32_t offset, uint32_t total, char* out)
+{
+    return inode->mount->filesystem->read_at(inode->mount->disk, inode->private, offset, total, out);
+}
+
+/* Note: reads (total) bytes from (offset) of the file through the page cache, the caller keeps the read inside the file.
+Cached pages are copied out, a run of pages that are not cached is read by the filesystem in one go straight into (out),
+and the pages it covered are cached from there */
+int vfs_read(struct vfs_inode* inode, uint32_t offset, uint32_t total, char* out)
+{
+    int res = 0;
+    struct pagecache_file* cache = vfs_inode_cache(inode);
+    if (!cache)
+    {
+        return vfs_read_uncached(inode, offset, total, out);
+    }
+
+    uint32_t end = offset + total;
+    while (offset < end)
+    {
+        uint32_t index = offset / PEACHOS_PAGECACHE_PAGE_SIZE;
+        uint32_t page_offset = offset % PEACHOS_PAGECACHE_PAGE_SIZE;
+        uint32_t chunk = PEACHOS_PAGECACHE_PAGE_SIZE - page_offset;
+        if (chunk > end - offset)
+        {
+            chunk = end - offset;
+        }
+
+        struct pagecache_page* page = pagecache_lookup(cache, index);
+        if (page)
+        {
+            memcpy(out, page->data + page_offset, chunk);
+            pagecache_put(page);
+            offset += chunk;
+            out += chunk;
+            continue;
+        }
+
+        // Here: we grow the run while the next page is not cached either
+        uint32_t run_end = offset + chunk;
+        while (run_end < end && !pagecache_contains(cache, run_end / PEACHOS_PAGECACHE_PAGE_SIZE))
+        {
+            run_end += end - run_end < PEACHOS_PAGECACHE_PAGE_SIZE ? end - run_end : PEACHOS_PAGECACHE_PAGE_SIZE;
+        }
+
+        res = vfs_read_uncached(inode, offset, run_end - offset, out);
+        if (res < 0)
+        {
+            return res;
+        }
+
+        // Note: only pages the read covered whole (or up to the end of the file) can be cached
+        uint32_t page_start = offset - page_offset;
+        while (page_start < run_end)
+        {
+            uint32_t page_end = page_start + PEACHOS_PAGECACHE_PAGE_SIZE;
+            if (page_end > inode->size)
+            {
+                page_end = inode->size;
+            }
+
+            if (page_start >= offset && page_end <= run_end)
+            {
+                pagecache_insert(cache, page_start / PEACHOS_PAGECACHE_PAGE_SIZE, out + (page_start - offset), page_end - page_start);
+            }
+            page_start += PEACHOS_PAGECACHE_PAGE_SIZE;
+        }
+
+        out += run_end - offset;
+        offset = run_end;
+    }
+
+    return 0;
+}
+
+// Note: reads page (index) of the inode straight into the cache page, the part past the end of the file is zero
+static int vfs_fill_page(void* private, uint32_t index, void* data)
+{
+    struct vfs_inode* inode = private;
+    uint32_t offset = index * PEACHOS_PAGECACHE_PAGE_SIZE;
+    uint32_t total = inode->size - offset;
+    if (total > PEACHOS_PAGECACHE_PAGE_SIZE)
+    {
+        total = PEACHOS_PAGECACHE_PAGE_SIZE;
+    }
+
+    memset(data + total, 0, PEACHOS_PAGECACHE_PAGE_SIZE - total);
+    return vfs_read_uncached(inode, offset, total, data);
+}
+
+// Note: page (index) of the file out of the page cache with a reference taken, 0 past the end of the file. Used to map files
+struct pagecache_page* vfs_get_page(struct vfs_inode* inode, uint32_t index)
+{
+    if (index >= (inode->size + PEACHOS_PAGECACHE_PAGE_SIZE - 1) / PEACHOS_PAGECACHE_PAGE_SIZE)
+    {
+        return 0;
+    }
+
+    struct pagecache_file* cache = vfs_inode_cache(inode);
+    if (!cache)
+    {
+        return 0;
+    }
+
+    return pagecache_fill(cache, index, vfs_fill_page, inode);
+}
+
+/* Note: writes (total) bytes at (offset) of the file through the filesystem, and returns how many it took. Cached pages
+the write touched get the new bytes too, so reads and shared mappings of the file see them right away */
+int vfs_write(struct vfs_inode* inode, uint32_t offset, uint32_t total, const char* in)
+{
+    struct filesystem* fs = inode->mount->filesystem;
+    if (!fs->write_at)
+    {
+        return -ERDONLY;
+    }
+
+    int res = fs->write_at(inode->mount->disk, inode->private, offset, total, in);
+    if (res <= 0)
+    {
+        return res;
+    }
+
+    // Note: pages of the file outlive its inode, ones cached by an earlier open are updated too
+    uint32_t end = offset + res;
+    struct pagecache_file* cache = vfs_inode_cache(inode);
+    if (cache)
+    {
+        uint32_t pos = offset;
+        while (pos < end)
+        {
+            uint32_t page_offset = pos % PEACHOS_PAGECACHE_PAGE_SIZE;
+            uint32_t chunk = PEACHOS_PAGECACHE_PAGE_SIZE - page_offset;
+            if (chunk > end - pos)
+            {
+                chunk = end - pos;
+            }
+
+            struct pagecache_page* page = pagecache_lookup(cache, pos / PEACHOS_PAGECACHE_PAGE_SIZE);
+            if (page)
+            {
+                memcpy(page->data + page_offset, (void*) in + (pos - offset), chunk);
+                pagecache_put(page);
+            }
+            pos += chunk;
+        }
+    }
+
+    if (end > inode->size)
+    {
+        inode->size = end;
+    }
+    return res;
+}
+
+// Note: cuts (or grows) the file to (size) bytes. Cached pages nobody holds are dropped, the ones still mapped read zeros past the end
+int vfs_truncate(struct vfs_inode* inode, uint32_t size)
+{
+    struct filesystem* fs = inode->mount->filesystem;
+    if (!fs->truncate)
+    {
+        return -ERDONLY;
+    }
+
+    int res = fs->truncate(inode->mount->disk, inode->private, size);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    uint32_t old_size = inode->size;
+    inode->size = size;
+    struct pagecache_file* cache = vfs_inode_cache(inode);
+    if (!cache || size >= old_size)
+    {
+        return 0;
+    }
+
+    pagecache_file_invalidate(cache);
+    for (uint32_t index = size / PEACHOS_PAGECACHE_PAGE_SIZE; index * PEACHOS_PAGECACHE_PAGE_SIZE < old_size; index++)
+    {
+        struct pagecache_page* page = pagecache_lookup(cache, index);
+        if (!page)
+        {
+            continue;
+        }
+
+        uint32_t keep = index == size / PEACHOS_PAGECACHE_PAGE_SIZE ? size % PEACHOS_PAGECACHE_PAGE_SIZE : 0;
+        memset(page->data + keep, 0, PEACHOS_PAGECACHE_PAGE_SIZE - keep);
+        pagecache_put(page);
+    }
+    return 0;
+}
+
+// Note: reserves room for (offset + length) bytes of the file, its size and cached pages stay as they are
+int vfs_fallocate(struct vfs_inode* inode, uint32_t offset, uint32_t length)
+{
+    struct filesystem* fs = inode->mount->filesystem;
+    if (!fs->fallocate)
+    {
+        return -EUNIMP;
+    }
+
+    return fs->fallocate(inode->mount->disk, inode->private, offset, length);
+}
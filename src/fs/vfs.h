@@ -0,0 +1,54 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "file.h"
+
+struct disk;
+struct pagecache_file;
+struct pagecache_page;
+
+// A filesystem instance reachable through a drive number in paths (0:/, 1:/, ...)
+struct vfs_mount
+{
+    int drive_no;
+    struct filesystem* filesystem;
+    // The disk the instance lives on, its fs_private holds the filesystem's own state
+    struct disk* disk;
+};
+
+// An open file in memory, shared by every descriptor open on it: its metadata, the filesystem's handle and its cached pages
+struct vfs_inode
+{
+    struct vfs_mount* mount;
+    // What the filesystem calls the file (see FS_INO_FUNCTION), 0 for a file that is never shared
+    uint32_t ino;
+    uint32_t size;
+    FILE_STAT_FLAGS flags;
+
+    // The filesystem's handle from open, closed with the last reference
+    void* private;
+    // The file's pages in the page cache, taken on first read (0 until then)
+    struct pagecache_file* cache;
+
+    // Descriptors (and other holders) using the inode
+    int refcount;
+    struct vfs_inode* hash_next;
+    // Is this slot of the pool in use
+    int used;
+};
+
+int vfs_mount(int drive_no, struct disk* disk);
+void vfs_mount_disks();
+struct vfs_mount* vfs_get_mount(int drive_no);
+
+struct vfs_inode* vfs_inode_get(struct vfs_mount* mount, void* private);
+void vfs_inode_put(struct vfs_inode* inode);
+int vfs_read(struct vfs_inode* inode, uint32_t offset, uint32_t total, char* out);
+int vfs_write(struct vfs_inode* inode, uint32_t offset, uint32_t total, const char* in);
+int vfs_truncate(struct vfs_inode* inode, uint32_t size);
+int vfs_fallocate(struct vfs_inode* inode, uint32_t offset, uint32_t length);
+struct pagecache_page* vfs_get_page(struct vfs_inode* inode, uint32_t index);
+
+#endif
@@ -4,6 +4,7 @@ extern int21h_handler
 extern no_interrupt_handler
 extern isr80h_handler
 extern interrupt_handler
+extern interrupt_error_code
 
 global idt_load
 global no_interrupt
@@ -40,6 +41,11 @@ no_interrupt:
 %macro interrupt 1
     global int%1
     int%1:
+        ; Exceptions 8, 10-14, 17, 21, 29 and 30 come with an error code on top of the frame, we move it out of the way
+        ; so every handler sees the same frame (and iret finds the ip where it expects it)
+%if %1 = 8 || (%1 >= 10 && %1 <= 14) || %1 = 17 || %1 = 21 || %1 = 29 || %1 = 30
+        pop dword [interrupt_error_code]
+%endif
         ; INTERRUPT FRAME START
         ; ALREADY PUSHED TO US BY THE PROCESSOR UPON ENTRY TO THIS INTERRUPT
         ; uint32_t ip
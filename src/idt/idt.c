@@ -6,11 +6,16 @@
 #include "task/task.h"
 #include "task/process.h"
 #include "status.h"
+#include "task/mmap.h"
+#include "memory/paging/paging.h"
 
 
 struct idt_desc idt_descriptors[PEACHOS_TOTAL_INTERRUPTS];
 struct idtr_desc idtr_descriptor;
 
+// Note: idt.asm saves the error code of the exceptions that have one here, before calling interrupt_handler
+uint32_t interrupt_error_code = 0;
+
 // Note: this is created by idt.asm (extern)
 extern void* interrupt_pointer_table[PEACHOS_TOTAL_INTERRUPTS];
 
@@ -60,6 +65,16 @@ void idt_handle_execption() {
     task_next();
 }
 
+// Note: page faults on pages of mapped files are filled in on demand, any other page fault still terminates the process
+void idt_page_fault() {
+    struct task* task = task_current();
+    if (task && process_handle_page_fault(task->process, paging_get_fault_address(), interrupt_error_code) == 0) {
+        return;
+    }
+
+    idt_handle_execption();
+}
+
 // Note: on every clock we switch to the next task (multitasking)
 int c = 0; // Just putting some delay before starting context switching
 void idt_clock() {
@@ -91,6 +106,7 @@ void idt_init()
     for (int i = 0; i < 0x20; i++) {
         idt_register_interrupt_callback(i, idt_handle_execption);
     }
+    idt_register_interrupt_callback(0x0E, idt_page_fault);
 
     // Here: we set the clock
     idt_register_interrupt_callback(0x20, idt_clock);
@@ -4,6 +4,8 @@ global insb
 global insw
 global outb
 global outw
+global insl
+global outl
 
 insb:
     push ebp
@@ -46,5 +48,27 @@ outw:
     mov edx, [ebp+8]
     out dx, ax
 
+    pop ebp
+    ret
+
+insl:
+    push ebp
+    mov ebp, esp
+
+    xor eax, eax
+    mov edx, [ebp+8]
+    in eax, dx
+
+    pop ebp
+    ret
+
+outl:
+    push ebp
+    mov ebp, esp
+
+    mov eax, [ebp+12]
+    mov edx, [ebp+8]
+    out dx, eax
+
     pop ebp
     ret
\ No newline at end of file
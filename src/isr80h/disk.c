@@ -0,0 +1,21 @@
+#include "disk.h"
+#include "idt/idt.h"
+#include "task/task.h"
+#include "kernel.h"
+#include "status.h"
+#include "disk/disk.h"
+#include "memory/memory.h"
+
+// Note: copies the I/O stats of a disk into the user's struct disk_stats, a negative return means there is no such disk
+void* isr80h_command10_disk_stats(struct interrupt_frame* frame) {
+    int disk_id = (int) task_get_stack_item(task_current(), 0);
+    void* stats_user_ptr = task_get_stack_item(task_current(), 1);
+
+    struct disk_stats* stats = task_virtual_address_to_physical(task_current(), stats_user_ptr);
+    if (!stats) {
+        return ERROR(-EINVARG);
+    }
+
+    int res = disk_get_stats(disk_id, stats);
+    return (void*) res;
+}
@@ -0,0 +1,357 @@
+#include "file.h"
+#include "idt/idt.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "task/mmap.h"
+#include "kernel.h"
+#include "config.h"
+#include "status.h"
+#include "fs/file.h"
+#include "memory/paging/paging.h"
+#include "string/string.h"
+
+// Note: opens (filename) from the user's (path_ptr) with the mode at (mode_ptr), relative to the open directory (at)
+static int isr80h_open_at(struct task* task, struct file_descriptor* at, void* path_ptr, void* mode_ptr) {
+    char filename[PEACHOS_MAX_PATH];
+    char mode[4];
+
+    int res = copy_string_from_task(task, path_ptr, filename, sizeof(filename));
+    if (res < 0) {
+        goto out;
+    }
+
+    res = copy_string_from_task(task, mode_ptr, mode, sizeof(mode));
+    if (res < 0) {
+        goto out;
+    }
+
+    struct file_descriptor* desc = file_open_at(at, filename, mode);
+    if (ISERR(desc)) {
+        res = ERROR_I(desc);
+        goto out;
+    }
+
+    res = file_table_install(&task->process->files, desc);
+    if (res < 0) {
+        file_put(desc);
+    }
+
+    out:
+        return res;
+}
+
+// Note: opens a file for the current process and returns the descriptor in its own table, relative paths start at its cwd
+void* isr80h_command11_fopen(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    return (void*) isr80h_open_at(task, task->process->cwd, task_get_stack_item(task, 0), task_get_stack_item(task, 1));
+}
+
+/* Note: the physical address of (virt) in the task and how many of the (max) bytes from there are in user pages that
+follow each other in physical memory too, so the whole run can be handed to the filesystem as one kernel buffer */
+// Note: with (writeable) the pages must be ones the task may write to, buffers we fill in
+static void* isr80h_user_run(struct task* task, void* virt, uint32_t max, int writeable, uint32_t* run) {
+    uint32_t* directory = task->page_directory->directory_entry;
+    int flags = PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | (writeable ? PAGING_IS_WRITEABLE : 0);
+    *run = 0;
+
+    // Check: the page must be one the task may use
+    if ((paging_get(directory, paging_align_to_lower_page(virt)) & flags) != flags) {
+        return 0;
+    }
+
+    char* phys = task_virtual_address_to_physical(task, virt);
+    uint32_t page_left = PAGING_PAGE_SIZE - ((uint32_t) virt % PAGING_PAGE_SIZE);
+    *run = page_left < max ? page_left : max;
+
+    // Here: we grow the run while the next page is mapped right after the last one
+    while (*run < max) {
+        void* next_virt = virt + *run;
+        if ((paging_get(directory, next_virt) & flags) != flags) {
+            break;
+        }
+
+        if (task_virtual_address_to_physical(task, next_virt) != phys + *run) {
+            break;
+        }
+
+        *run += max - *run < PAGING_PAGE_SIZE ? max - *run : PAGING_PAGE_SIZE;
+    }
+
+    return phys;
+}
+
+// Note: reads up to (count) bytes of an open file straight into the user's buffer and returns how many were read
+// Note: there is no bounce buffer, the filesystem fills the user's pages through their physical (identity mapped) address
+void* isr80h_command12_fread(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    void* user_ptr = task_get_stack_item(task, 1);
+    uint32_t count = (uint32_t) task_get_stack_item(task, 2);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    // Check: the result has to fit the return value
+    if (count > 0x7FFFFFFF) {
+        count = 0x7FFFFFFF;
+    }
+
+    int total = 0;
+    while (count > 0) {
+        uint32_t run = 0;
+        void* phys = isr80h_user_run(task, user_ptr, count, 1, &run);
+        if (!phys) {
+            return total ? (void*) total : ERROR(-EINVARG);
+        }
+
+        int res = file_read(desc, phys, 1, run);
+        if (res < 0) {
+            return total ? (void*) total : ERROR(res);
+        }
+
+        total += res;
+        user_ptr += res;
+        count -= res;
+
+        // Note: a short read means we are at the end of the file
+        if (res < run) {
+            break;
+        }
+    }
+
+    return (void*) total;
+}
+
+void* isr80h_command13_fseek(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    int offset = (int) task_get_stack_item(task, 1);
+    FILE_SEEK_MODE whence = (FILE_SEEK_MODE) task_get_stack_item(task, 2);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    return (void*) file_seek(desc, offset, whence);
+}
+
+// Note: fills the user's struct file_stat
+void* isr80h_command14_fstat(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    void* stat_user_ptr = task_get_stack_item(task, 1);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    struct file_stat* stat = task_virtual_address_to_physical(task, stat_user_ptr);
+    if (!desc || !stat) {
+        return ERROR(-EINVARG);
+    }
+
+    return (void*) file_stat(desc, stat);
+}
+
+void* isr80h_command15_fclose(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    return (void*) file_table_close(&task->process->files, fd);
+}
+
+// Note: maps (size) bytes of an open file from (offset) into the process, returns the address or a negative status
+void* isr80h_command16_mmap(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    uint32_t offset = (uint32_t) task_get_stack_item(task, 1);
+    uint32_t size = (uint32_t) task_get_stack_item(task, 2);
+    int flags = (int) task_get_stack_item(task, 3);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    return process_mmap(task->process, desc, offset, size, flags);
+}
+
+void* isr80h_command17_munmap(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    void* start = task_get_stack_item(task, 0);
+    return (void*) process_munmap(task->process, start);
+}
+
+// Note: opens a directory for listing and returns a descriptor of the process, it is closed like a file
+void* isr80h_command18_opendir(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    char path[PEACHOS_MAX_PATH];
+    int res = copy_string_from_task(task, task_get_stack_item(task, 0), path, sizeof(path));
+    if (res < 0) {
+        return (void*) res;
+    }
+
+    struct file_descriptor* desc = file_opendir_at(task->process->cwd, path);
+    if (ISERR(desc)) {
+        return desc;
+    }
+
+    res = file_table_install(&task->process->files, desc);
+    if (res < 0) {
+        file_put(desc);
+    }
+    return (void*) res;
+}
+
+// Note: fills the user's buffer of (size) bytes with as many struct file_dirent as fit, one call lists a whole directory
+// cluster or more. Returns how many entries were filled in, 0 when the listing is done
+void* isr80h_command19_readdir(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    void* user_ptr = task_get_stack_item(task, 1);
+    uint32_t size = (uint32_t) task_get_stack_item(task, 2);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    // Here: the entries are written straight into the user's pages, as far as they are contiguous
+    uint32_t run = 0;
+    void* phys = isr80h_user_run(task, user_ptr, size, 1, &run);
+    int max = run / sizeof(struct file_dirent);
+    if (!phys || max == 0) {
+        return ERROR(-EINVARG);
+    }
+
+    return (void*) file_readdir(desc, phys, max);
+}
+
+// Note: writes (count) bytes of the user's buffer to an open file and returns how many were written
+// Note: like fread there is no bounce buffer, the filesystem copies straight out of the user's pages
+void* isr80h_command20_fwrite(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    void* user_ptr = task_get_stack_item(task, 1);
+    uint32_t count = (uint32_t) task_get_stack_item(task, 2);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    // Check: the result has to fit the return value
+    if (count > 0x7FFFFFFF) {
+        count = 0x7FFFFFFF;
+    }
+
+    int total = 0;
+    while (count > 0) {
+        uint32_t run = 0;
+        void* phys = isr80h_user_run(task, user_ptr, count, 0, &run);
+        if (!phys) {
+            return total ? (void*) total : ERROR(-EINVARG);
+        }
+
+        int res = file_write(desc, phys, 1, run);
+        if (res < 0) {
+            return total ? (void*) total : ERROR(res);
+        }
+
+        total += res;
+        user_ptr += res;
+        count -= res;
+
+        // Note: a short write means the filesystem is out of room
+        if (res < run) {
+            break;
+        }
+    }
+
+    return (void*) total;
+}
+
+void* isr80h_command21_mkdir(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    char path[PEACHOS_MAX_PATH];
+    int res = copy_string_from_task(task, task_get_stack_item(task, 0), path, sizeof(path));
+    if (res < 0) {
+        return (void*) res;
+    }
+
+    return (void*) file_mkdir_at(task->process->cwd, path);
+}
+
+// Note: makes (path) the current directory of the process, relative to the current one
+void* isr80h_command22_chdir(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    char path[PEACHOS_MAX_PATH];
+    int res = copy_string_from_task(task, task_get_stack_item(task, 0), path, sizeof(path));
+    if (res < 0) {
+        return (void*) res;
+    }
+
+    struct file_descriptor* cwd = file_opendir_at(task->process->cwd, path);
+    if (ISERR(cwd)) {
+        return cwd;
+    }
+
+    // Note: the directory stays open as the cwd, later lookups start from it instead of the root
+    if (task->process->cwd) {
+        file_put(task->process->cwd);
+    }
+    task->process->cwd = cwd;
+    return 0;
+}
+
+// Note: copies the absolute path of the current directory into the user's buffer of (size) bytes
+void* isr80h_command23_getcwd(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    void* user_ptr = task_get_stack_item(task, 0);
+    uint32_t size = (uint32_t) task_get_stack_item(task, 1);
+
+    struct file_descriptor* cwd = task->process->cwd;
+    if (!cwd) {
+        return ERROR(-EIO);
+    }
+
+    // Check: the whole path and its terminator must fit where we can write
+    uint32_t run = 0;
+    char* phys = isr80h_user_run(task, user_ptr, size, 1, &run);
+    if (!phys || run <= strlen(cwd->path)) {
+        return ERROR(-EINVARG);
+    }
+
+    strcpy(phys, cwd->path);
+    return 0;
+}
+
+// Note: like fopen, a relative path is looked up from the open directory (dirfd) of the process, PEACHOS_AT_CWD is the cwd
+void* isr80h_command24_openat(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int dirfd = (int) task_get_stack_item(task, 0);
+
+    struct file_descriptor* at = task->process->cwd;
+    if (dirfd != PEACHOS_AT_CWD) {
+        at = file_table_get(&task->process->files, dirfd);
+        if (!at) {
+            return ERROR(-EINVARG);
+        }
+    }
+
+    return (void*) isr80h_open_at(task, at, task_get_stack_item(task, 1), task_get_stack_item(task, 2));
+}
+
+// Note: reserves room on disk for (offset + length) bytes of a file open for writing
+void* isr80h_command25_fallocate(struct interrupt_frame* frame) {
+    struct task* task = task_current();
+    int fd = (int) task_get_stack_item(task, 0);
+    uint32_t offset = (uint32_t) task_get_stack_item(task, 1);
+    uint32_t length = (uint32_t) task_get_stack_item(task, 2);
+
+    struct file_descriptor* desc = file_table_get(&task->process->files, fd);
+    if (!desc) {
+        return ERROR(-EINVARG);
+    }
+
+    return (void*) file_fallocate(desc, offset, length);
+}
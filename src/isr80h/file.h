@@ -0,0 +1,22 @@
+#ifndef ISR80H_FILE_H
+#define ISR80H_FILE_H
+
+struct interrupt_frame;
+
+void* isr80h_command11_fopen(struct interrupt_frame* frame);
+void* isr80h_command12_fread(struct interrupt_frame* frame);
+void* isr80h_command13_fseek(struct interrupt_frame* frame);
+void* isr80h_command14_fstat(struct interrupt_frame* frame);
+void* isr80h_command15_fclose(struct interrupt_frame* frame);
+void* isr80h_command16_mmap(struct interrupt_frame* frame);
+void* isr80h_command17_munmap(struct interrupt_frame* frame);
+void* isr80h_command18_opendir(struct interrupt_frame* frame);
+void* isr80h_command19_readdir(struct interrupt_frame* frame);
+void* isr80h_command20_fwrite(struct interrupt_frame* frame);
+void* isr80h_command21_mkdir(struct interrupt_frame* frame);
+void* isr80h_command22_chdir(struct interrupt_frame* frame);
+void* isr80h_command23_getcwd(struct interrupt_frame* frame);
+void* isr80h_command24_openat(struct interrupt_frame* frame);
+void* isr80h_command25_fallocate(struct interrupt_frame* frame);
+
+#endif
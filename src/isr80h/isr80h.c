@@ -4,6 +4,8 @@
 #include "io.h"
 #include "heap.h"
 #include "process.h"
+#include "disk.h"
+#include "file.h"
 
 
 void isr80h_register_commands()
@@ -18,4 +20,20 @@ void isr80h_register_commands()
     isr80h_register_command(SYSTEM_COMMAND7_INVOKE_SYSTEM_COMMAND, isr80h_command7_invoke_system_command);
     isr80h_register_command(SYSTEM_COMMAND8_GET_PROGRAM_ARGUMENTS, isr80h_command8_get_program_arguments);
     isr80h_register_command(SYSTEM_COMMAND9_EXIT, isr80h_command9_exit);
+    isr80h_register_command(SYSTEM_COMMAND10_DISK_STATS, isr80h_command10_disk_stats);
+    isr80h_register_command(SYSTEM_COMMAND11_FOPEN, isr80h_command11_fopen);
+    isr80h_register_command(SYSTEM_COMMAND12_FREAD, isr80h_command12_fread);
+    isr80h_register_command(SYSTEM_COMMAND13_FSEEK, isr80h_command13_fseek);
+    isr80h_register_command(SYSTEM_COMMAND14_FSTAT, isr80h_command14_fstat);
+    isr80h_register_command(SYSTEM_COMMAND15_FCLOSE, isr80h_command15_fclose);
+    isr80h_register_command(SYSTEM_COMMAND16_MMAP, isr80h_command16_mmap);
+    isr80h_register_command(SYSTEM_COMMAND17_MUNMAP, isr80h_command17_munmap);
+    isr80h_register_command(SYSTEM_COMMAND18_OPENDIR, isr80h_command18_opendir);
+    isr80h_register_command(SYSTEM_COMMAND19_READDIR, isr80h_command19_readdir);
+    isr80h_register_command(SYSTEM_COMMAND20_FWRITE, isr80h_command20_fwrite);
+    isr80h_register_command(SYSTEM_COMMAND21_MKDIR, isr80h_command21_mkdir);
+    isr80h_register_command(SYSTEM_COMMAND22_CHDIR, isr80h_command22_chdir);
+    isr80h_register_command(SYSTEM_COMMAND23_GETCWD, isr80h_command23_getcwd);
+    isr80h_register_command(SYSTEM_COMMAND24_OPENAT, isr80h_command24_openat);
+    isr80h_register_command(SYSTEM_COMMAND25_FALLOCATE, isr80h_command25_fallocate);
 }
\ No newline at end of file
@@ -12,7 +12,23 @@ enum SystemCommands {
     SYSTEM_COMMAND6_PROCESS_LOAD_START,
     SYSTEM_COMMAND7_INVOKE_SYSTEM_COMMAND,
     SYSTEM_COMMAND8_GET_PROGRAM_ARGUMENTS,
-    SYSTEM_COMMAND9_EXIT
+    SYSTEM_COMMAND9_EXIT,
+    SYSTEM_COMMAND10_DISK_STATS,
+    SYSTEM_COMMAND11_FOPEN,
+    SYSTEM_COMMAND12_FREAD,
+    SYSTEM_COMMAND13_FSEEK,
+    SYSTEM_COMMAND14_FSTAT,
+    SYSTEM_COMMAND15_FCLOSE,
+    SYSTEM_COMMAND16_MMAP,
+    SYSTEM_COMMAND17_MUNMAP,
+    SYSTEM_COMMAND18_OPENDIR,
+    SYSTEM_COMMAND19_READDIR,
+    SYSTEM_COMMAND20_FWRITE,
+    SYSTEM_COMMAND21_MKDIR,
+    SYSTEM_COMMAND22_CHDIR,
+    SYSTEM_COMMAND23_GETCWD,
+    SYSTEM_COMMAND24_OPENAT,
+    SYSTEM_COMMAND25_FALLOCATE
 };
 
 void isr80h_register_commands();
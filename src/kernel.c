@@ -7,6 +7,8 @@
 #include "memory/memory.h"
 #include "string/string.h"
 #include "fs/file.h"
+#include "fs/vfs.h"
+#include "fs/tmpfs/tmpfs.h"
 #include "disk/disk.h"
 #include "fs/pparser.h"
 #include "disk/streamer.h"
@@ -71,6 +73,13 @@ void kernel_main()
     // Search and initialize the disks. Checks for filesystems for that disk and binds it to the disk
     disk_search_and_init();
 
+    // Mount every disk we found a filesystem on, and a tmpfs for scratch files. Paths reach files through the mount table
+    vfs_mount_disks();
+    if (tmpfs_mount(PEACHOS_TMPFS_DRIVE) < 0)
+    {
+        print("tmpfs: could not mount 9:/\n");
+    }
+
     // Initialize the interrupt descriptor table
     idt_init();
 
@@ -4,6 +4,7 @@ section .asm
 
 global paging_load_directory
 global enable_paging
+global paging_get_fault_address
 
 ; Which directory we want to use at the moment
 paging_load_directory:
@@ -22,3 +23,9 @@ enable_paging:
     mov cr0, eax 
     pop ebp
     ret
+
+; void* paging_get_fault_address()
+; The address the last page fault happened on
+paging_get_fault_address:
+    mov eax, cr2
+    ret
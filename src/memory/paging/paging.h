@@ -51,6 +51,7 @@ struct paging_4gb_chunk* paging_new_4gb(uint8_t flags);
 void paging_free_4gb(struct paging_4gb_chunk* chunk);
 void paging_switch(struct paging_4gb_chunk* directory);
 void enable_paging();
+void* paging_get_fault_address();
 
 int paging_map_to(struct paging_4gb_chunk* directory, void* virt, void* phys, void* phys_end, int flags);
 int paging_map_range(struct paging_4gb_chunk* directory, void* virt, void* phys, int count, int flags);
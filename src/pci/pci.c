@@ -0,0 +1,157 @@
+#include "pci.h"
+#include "io/io.h"
+#include "status.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+// Configuration mechanism #1 ports
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+#define PCI_MAX_BUSES 256
+#define PCI_MAX_SLOTS 32
+#define PCI_MAX_FUNCTIONS 8
+
+typedef bool (*PCI_MATCH_FUNCTION)(struct pci_device* device, void* private);
+
+// Note: builds the address of a 32-bit register in the configuration space of bus:slot.function
+static uint32_t pci_config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    return 0x80000000 | ((uint32_t) bus << 16) | ((uint32_t) slot << 11) | ((uint32_t) function << 8) | (offset & 0xFC);
+}
+
+static uint32_t pci_read32(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(bus, slot, function, offset));
+    return insl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_config_read32(struct pci_device* device, uint8_t offset)
+{
+    return pci_read32(device->bus, device->slot, device->function, offset);
+}
+
+uint16_t pci_config_read16(struct pci_device* device, uint8_t offset)
+{
+    return (uint16_t)(pci_config_read32(device, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(struct pci_device* device, uint8_t offset)
+{
+    return (uint8_t)(pci_config_read32(device, offset) >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(struct pci_device* device, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(device->bus, device->slot, device->function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Note: fills the device structure from its configuration space, returns false if nothing lives there
+static bool pci_probe(uint8_t bus, uint8_t slot, uint8_t function, struct pci_device* device)
+{
+    uint32_t id = pci_read32(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF)
+    {
+        return false;
+    }
+
+    memset(device, 0, sizeof(struct pci_device));
+    device->bus = bus;
+    device->slot = slot;
+    device->function = function;
+    device->vendor_id = id & 0xFFFF;
+    device->device_id = id >> 16;
+    device->class_code = pci_config_read8(device, PCI_CONFIG_CLASS);
+    device->subclass = pci_config_read8(device, PCI_CONFIG_SUBCLASS);
+    device->prog_if = pci_config_read8(device, PCI_CONFIG_PROG_IF);
+    device->interrupt_line = pci_config_read8(device, PCI_CONFIG_INTERRUPT_LINE);
+    return true;
+}
+
+// Note: brute force walk of every bus/slot/function, returns the (index)th device the match function accepts
+static int pci_find(PCI_MATCH_FUNCTION match, void* private, int index, struct pci_device* device_out)
+{
+    struct pci_device device;
+    for (int bus = 0; bus < PCI_MAX_BUSES; bus++)
+    {
+        for (int slot = 0; slot < PCI_MAX_SLOTS; slot++)
+        {
+            for (int function = 0; function < PCI_MAX_FUNCTIONS; function++)
+            {
+                if (!pci_probe(bus, slot, function, &device))
+                {
+                    // Check: no function 0 means there is no device in this slot
+                    if (function == 0)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                if (match(&device, private) && index-- == 0)
+                {
+                    *device_out = device;
+                    return 0;
+                }
+
+                // Check: single function devices only answer on function 0
+                if (function == 0 && !(pci_config_read8(&device, PCI_CONFIG_HEADER_TYPE) & 0x80))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    return -EIO;
+}
+
+struct pci_class_match
+{
+    uint8_t class_code;
+    uint8_t subclass;
+    int prog_if;
+};
+
+static bool pci_match_class(struct pci_device* device, void* private)
+{
+    struct pci_class_match* match = private;
+    return device->class_code == match->class_code && device->subclass == match->subclass &&
+        (match->prog_if == PCI_ANY_PROG_IF || device->prog_if == match->prog_if);
+}
+
+static bool pci_match_id(struct pci_device* device, void* private)
+{
+    uint16_t* ids = private;
+    return device->vendor_id == ids[0] && device->device_id == ids[1];
+}
+
+// Note: finds the (index)th device of the given class, e.g. 01:06:01 is an AHCI controller
+int pci_find_class(uint8_t class_code, uint8_t subclass, int prog_if, int index, struct pci_device* device_out)
+{
+    struct pci_class_match match = { .class_code = class_code, .subclass = subclass, .prog_if = prog_if };
+    return pci_find(pci_match_class, &match, index, device_out);
+}
+
+// Note: finds the (index)th device with the given vendor and device id
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device* device_out)
+{
+    uint16_t ids[2] = { vendor_id, device_id };
+    return pci_find(pci_match_id, ids, index, device_out);
+}
+
+// Note: returns the raw base address register, callers mask off the type bits they do not need
+uint32_t pci_get_bar(struct pci_device* device, int bar)
+{
+    return pci_config_read32(device, PCI_CONFIG_BAR0 + bar * 4);
+}
+
+// Note: turns on decoding (and bus mastering) for the device
+void pci_enable(struct pci_device* device, uint16_t command_bits)
+{
+    uint32_t command = pci_config_read32(device, PCI_CONFIG_COMMAND);
+    // Note: the upper half is the status register, writing its bits back would clear them
+    command = (command & 0xFFFF) | command_bits;
+    pci_config_write32(device, PCI_CONFIG_COMMAND, command);
+}
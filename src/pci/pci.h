@@ -0,0 +1,51 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// Configuration space offsets we care about
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_DEVICE_ID 0x02
+#define PCI_CONFIG_COMMAND 0x04
+#define PCI_CONFIG_PROG_IF 0x09
+#define PCI_CONFIG_SUBCLASS 0x0A
+#define PCI_CONFIG_CLASS 0x0B
+#define PCI_CONFIG_HEADER_TYPE 0x0E
+#define PCI_CONFIG_BAR0 0x10
+#define PCI_CONFIG_INTERRUPT_LINE 0x3C
+
+// Command register bits
+#define PCI_COMMAND_IO_SPACE 0x01
+#define PCI_COMMAND_MEMORY_SPACE 0x02
+#define PCI_COMMAND_BUS_MASTER 0x04
+
+// Used as prog_if when any programming interface is fine
+#define PCI_ANY_PROG_IF -1
+
+struct pci_device
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+
+    uint8_t interrupt_line;
+};
+
+uint32_t pci_config_read32(struct pci_device* device, uint8_t offset);
+uint16_t pci_config_read16(struct pci_device* device, uint8_t offset);
+uint8_t pci_config_read8(struct pci_device* device, uint8_t offset);
+void pci_config_write32(struct pci_device* device, uint8_t offset, uint32_t value);
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, int prog_if, int index, struct pci_device* device_out);
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, struct pci_device* device_out);
+uint32_t pci_get_bar(struct pci_device* device, int bar);
+void pci_enable(struct pci_device* device, uint16_t command_bits);
+
+#endif
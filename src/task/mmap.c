@@ -0,0 +1,193 @@
+#include "mmap.h"
+#include "process.h"
+#include "task.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "fs/file.h"
+#include "fs/pagecache.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/paging/paging.h"
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT 0x01 // The page was present, so this is a protection fault
+#define PAGE_FAULT_WRITE   0x02
+#define PAGE_FAULT_USER    0x04
+
+// Note: an available bit of the page table entry, set on pages that are the process's own copy (kmalloc'd) and not a cache page
+#define PROCESS_MMAP_PRIVATE_COPY 0x200
+
+// Note: the flags every page of a task directory has until we take it over, see task_new
+#define PROCESS_MMAP_IDENTITY_FLAGS (PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL)
+
+static struct process_mapping* process_find_mapping(struct process* process, void* address) {
+    for (int i = 0; i < PEACHOS_MAX_PROCESS_MAPPINGS; i++) {
+        struct process_mapping* mapping = &process->mappings[i];
+        if (mapping->file && address >= mapping->start && address < mapping->start + mapping->size) {
+            return mapping;
+        }
+    }
+
+    return 0;
+}
+
+/* Note: maps (size) bytes of an open file from (offset) into the process and returns where. Nothing is read here: the
+pages are left not present and the page fault handler fills them in from the page cache on the first access */
+// Note: (offset) has to be page aligned, the mapping keeps its own reference on the file so closing the descriptor is fine
+void* process_mmap(struct process* process, struct file_descriptor* desc, uint32_t offset, uint32_t size, int flags) {
+    int res = 0;
+    struct process_mapping* mapping = 0;
+    struct pagecache_page** pages = 0;
+
+    if (size == 0 || offset % PAGING_PAGE_SIZE || (flags != PEACHOS_MAP_SHARED && flags != PEACHOS_MAP_PRIVATE)) {
+        res = -EINVARG;
+        goto out;
+    }
+
+    // Check: only files have pages to map
+    if (desc->type != FILE_TYPE_FILE) {
+        res = -EINVARG;
+        goto out;
+    }
+
+    uint32_t total_pages = (size + PAGING_PAGE_SIZE - 1) / PAGING_PAGE_SIZE;
+    void* start = process->mmap_next ? process->mmap_next : (void*) PEACHOS_MMAP_VIRTUAL_ADDRESS;
+    if (total_pages > (PEACHOS_MMAP_VIRTUAL_ADDRESS + PEACHOS_MMAP_VIRTUAL_SIZE - (uint32_t) start) / PAGING_PAGE_SIZE) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    for (int i = 0; i < PEACHOS_MAX_PROCESS_MAPPINGS; i++) {
+        if (!process->mappings[i].file) {
+            mapping = &process->mappings[i];
+            break;
+        }
+    }
+
+    if (!mapping) {
+        res = -EISTKN;
+        goto out;
+    }
+
+    pages = kzalloc(total_pages * sizeof(struct pagecache_page*));
+    if (!pages) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    // Here: we take the pages away from the process, touching any of them now faults
+    for (uint32_t i = 0; i < total_pages; i++) {
+        paging_set(process->task->page_directory->directory_entry, start + i * PAGING_PAGE_SIZE, 0);
+    }
+
+    file_get(desc);
+    mapping->start = start;
+    mapping->size = total_pages * PAGING_PAGE_SIZE;
+    mapping->file = desc;
+    mapping->first_page = offset / PAGING_PAGE_SIZE;
+    mapping->flags = flags;
+    mapping->pages = pages;
+    process->mmap_next = start + mapping->size;
+
+    out:
+        if (res < 0) {
+            return ERROR(res);
+        }
+        return start;
+}
+
+// Note: gives the mapping's pages back: cache pages are released, private copies freed, and the identity mapping restored
+static void process_release_mapping(struct process* process, struct process_mapping* mapping) {
+    uint32_t* directory = process->task->page_directory->directory_entry;
+    int total_pages = mapping->size / PAGING_PAGE_SIZE;
+    for (int i = 0; i < total_pages; i++) {
+        void* virt = mapping->start + i * PAGING_PAGE_SIZE;
+        uint32_t entry = paging_get(directory, virt);
+        if (entry & PROCESS_MMAP_PRIVATE_COPY) {
+            kfree((void*) (entry & 0xFFFFF000));
+        }
+
+        if (mapping->pages[i]) {
+            pagecache_put(mapping->pages[i]);
+        }
+
+        paging_map(process->task->page_directory, virt, virt, PROCESS_MMAP_IDENTITY_FLAGS);
+    }
+
+    // Note: the address space is handed out in order, we can only give it back if this was the last mapping
+    if (process->mmap_next == mapping->start + mapping->size) {
+        process->mmap_next = mapping->start;
+    }
+
+    file_put(mapping->file);
+    kfree(mapping->pages);
+    memset(mapping, 0, sizeof(struct process_mapping));
+}
+
+int process_munmap(struct process* process, void* start) {
+    struct process_mapping* mapping = process_find_mapping(process, start);
+    if (!mapping || mapping->start != start) {
+        return -EINVARG;
+    }
+
+    process_release_mapping(process, mapping);
+    return 0;
+}
+
+void process_munmap_all(struct process* process) {
+    for (int i = 0; i < PEACHOS_MAX_PROCESS_MAPPINGS; i++) {
+        if (process->mappings[i].file) {
+            process_release_mapping(process, &process->mappings[i]);
+        }
+    }
+}
+
+/* Note: called on a page fault of the process. A fault on a mapped page that is not present maps the file's page straight
+out of the page cache, read-only and shared with everyone else. A write to it in a private mapping replaces it with the
+process's own copy. Returns 0 when the fault was handled and the instruction can run again */
+int process_handle_page_fault(struct process* process, void* address, uint32_t error_code) {
+    // Check: only faults from user mode can be ours
+    if (!process || !(error_code & PAGE_FAULT_USER)) {
+        return -EINVARG;
+    }
+
+    struct process_mapping* mapping = process_find_mapping(process, address);
+    if (!mapping) {
+        return -EINVARG;
+    }
+
+    void* virt = paging_align_to_lower_page(address);
+    int i = (virt - mapping->start) / PAGING_PAGE_SIZE;
+    struct paging_4gb_chunk* directory = process->task->page_directory;
+
+    if (!(error_code & PAGE_FAULT_PRESENT)) {
+        // Note: a page wholly past the end of the file has nothing behind it
+        struct pagecache_page* page = file_get_page(mapping->file, mapping->first_page + i);
+        if (!page) {
+            return -EIO;
+        }
+
+        mapping->pages[i] = page;
+        paging_map(directory, virt, page->data, PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+        if (!(error_code & PAGE_FAULT_WRITE)) {
+            return 0;
+        }
+    }
+
+    // Here: a write, only private mappings may do that and they get their own copy of the page
+    if (!(mapping->flags & PEACHOS_MAP_PRIVATE) || !mapping->pages[i]) {
+        return -EINVARG;
+    }
+
+    void* copy = kmalloc(PAGING_PAGE_SIZE);
+    if (!copy) {
+        return -ENOMEM;
+    }
+
+    memcpy(copy, mapping->pages[i]->data, PAGING_PAGE_SIZE);
+    pagecache_put(mapping->pages[i]);
+    mapping->pages[i] = 0;
+    paging_map(directory, virt, copy, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL | PROCESS_MMAP_PRIVATE_COPY);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stdint.h>
+
+// Mapping flags: a shared mapping is read-only, a private one can be written and gets its own copy of a page on the first write
+#define PEACHOS_MAP_SHARED  0
+#define PEACHOS_MAP_PRIVATE 1
+
+struct process;
+struct file_descriptor;
+
+void* process_mmap(struct process* process, struct file_descriptor* desc, uint32_t offset, uint32_t size, int flags);
+int process_munmap(struct process* process, void* start);
+void process_munmap_all(struct process* process);
+int process_handle_page_fault(struct process* process, void* address, uint32_t error_code);
+
+#endif
@@ -10,15 +10,17 @@
 #include "string/string.h"
 #include "memory/paging/paging.h"
 #include "loader/formats/elfloader.h"
+#include "mmap.h"
 
 // Current process that is running
 struct process* current_process = 0;
 
 static struct process* processes[PEACHOS_MAX_PROCESSES] = {};
 
-// Note: just memset the structure
+// Note: just memset the structure, and set up an empty descriptor table
 static void process_init(struct process* process) {
     memset(process, 0, sizeof(struct process));
+    file_table_init(&process->files);
 }
 
 // Note: returns current_process variable
@@ -188,6 +190,13 @@ int process_terminate(struct process* process) {
     //Here: we free the process stack
     kfree(process->stack);
 
+    // Here: we unmap and close every file the process left mapped or open
+    process_munmap_all(process);
+    file_table_close_all(&process->files);
+    if (process->cwd) {
+        file_put(process->cwd);
+    }
+
     task_free(process->task);
 
     process_unlink(process);
@@ -463,7 +472,7 @@ int process_load_switch(const char* filename, struct process** process) {
 int process_load_for_slot(const char* filename, struct process** process, int process_slot) {
     int res = 0;
     struct task* task = 0;
-    struct process* _process;
+    struct process* _process = 0;
     void* program_stack_ptr = 0;
 
     // Check: if the index is valid
@@ -482,6 +491,15 @@ int process_load_for_slot(const char* filename, struct process** process, int pr
     // Here: we initialize the process
     process_init(_process);
 
+    // Note: a process starts where the process that loads it is, the first one at the root of 0:/
+    if (current_process && current_process->cwd) {
+        _process->cwd = current_process->cwd;
+        file_get(_process->cwd);
+    } else {
+        struct file_descriptor* cwd = file_opendir("0:/");
+        _process->cwd = ISERR(cwd) ? 0 : cwd;
+    }
+
     res = process_load_data(filename, _process);
 
     // Check: if there is a problem loading data
@@ -534,6 +552,9 @@ int process_load_for_slot(const char* filename, struct process** process, int pr
             if (_process && _process->task) {
                 task_free(_process->task);
             }
+            if (_process && _process->cwd) {
+                file_put(_process->cwd);
+            }
             // ToDo: Free the process data
         }
         return res;
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "config.h"
 #include "task.h"
+#include "fs/file.h"
 
 #define PROCESS_FILETYPE_ELF    0
 #define PROCESS_FILETYPE_BINARY 1
@@ -15,6 +16,21 @@ struct process_allocation {
     size_t size;
 };
 
+// A file region mapped into the process, its pages are filled in on the first access
+struct process_mapping {
+    void* start;
+    uint32_t size;
+
+    // Our own reference on the open file, 0 when this slot is free
+    struct file_descriptor* file;
+    // Page of the file the mapping starts at
+    uint32_t first_page;
+    int flags;
+
+    // The cache page each page of the mapping shows (pinned), 0 if not faulted in yet or replaced by a private copy
+    struct pagecache_page** pages;
+};
+
 struct command_argument {
     char argument[512];
     struct command_argument* next;
@@ -59,6 +75,15 @@ struct process {
     struct process_arguments arguments;
 
     struct shell* shell;
+
+    // The files this process has open, closed when it terminates
+    struct file_table files;
+    // The current directory, relative paths of the process are looked up from it (0 if it has none)
+    struct file_descriptor* cwd;
+
+    // Files mapped into memory, and where the next mapping goes
+    struct process_mapping mappings[PEACHOS_MAX_PROCESS_MAPPINGS];
+    void* mmap_next;
 };
 
 struct process* process_current();